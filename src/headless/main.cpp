@@ -1,23 +1,55 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <map>
+#include <span>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 #include <openvic-simulation/GameManager.hpp>
 #include <openvic-simulation/dataloader/Dataloader.hpp>
 #include <openvic-simulation/testing/Testing.hpp>
 #include <openvic-simulation/utility/Logger.hpp>
+#include <openvic-simulation/utility/Profiler.hpp>
 
 using namespace OpenVic;
 
 static void print_help(std::ostream& stream, char const* program_name) {
 	stream
-		<< "Usage: " << program_name << " [-h] [-t] [-b <path>] [path]+\n"
+		<< "Usage: " << program_name
+		<< " [-h] [-t] [-j <threads>] [--bench <days>] [-c <path>] [--shape-runs] [-b <path>] [path]+\n"
 		<< "    -h : Print this help message and exit the program.\n"
 		<< "    -t : Run tests after loading defines.\n"
+		<< "    -j : Run the simulation on the following number of worker threads (default 0, i.e. serially).\n"
+		<< "    --bench : Time loading, simulate the following number of days from the first bookmark and generate every\n"
+		<< "              mapmode, then print a JSON report to stdout. Info logging is suppressed in this mode.\n"
+		<< "    -c : Cache preprocessed map data in the following directory, to speed up later loads of the same map.\n"
+		<< "    --shape-runs : Store the province shape image as runs of identical pixels, using much less memory.\n"
 		<< "    -b : Use the following path as the base directory (instead of searching for one).\n"
 		<< "    -s : Use the following path as a hint to search for a base directory.\n"
 		<< "Any following paths are read as mod directories, with priority starting at one above the base directory.\n"
 		<< "(Paths with spaces need to be enclosed in \"quotes\").\n";
 }
 
+/* Settings shared by normal and benchmark runs. */
+struct run_options_t {
+	fs::path map_cache_directory;
+	ProvinceShapeImage::storage_t shape_storage = ProvinceShapeImage::storage_t::RAW;
+	size_t thread_count = 0;
+};
+
+static void apply_run_options(run_options_t const& options, Dataloader& dataloader, GameManager& game_manager) {
+	dataloader.set_map_cache_directory(options.map_cache_directory);
+	game_manager.get_map().set_province_shape_storage(options.shape_storage);
+	game_manager.get_thread_pool().set_thread_count(options.thread_count);
+}
+
 static bool headless_load(GameManager& game_manager, Dataloader const& dataloader) {
 	bool ret = true;
 
@@ -30,18 +62,368 @@ static bool headless_load(GameManager& game_manager, Dataloader const& dataloade
 		ret = false;
 	}
 	if (!dataloader.load_localisation_files(
-		[](std::string_view key, Dataloader::locale_t locale, std::string_view localisation) -> bool {
+		[](std::string_view /* key */, Dataloader::locale_t /* locale */, std::string_view /* localisation */) -> bool {
+			return true;
+		}
+	)) {
+		Logger::error("Failed to load localisation!");
+		ret = false;
+	}
+
+	return ret;
+}
+
+/* Returns the process's peak resident set size in bytes, or 0 if it cannot be determined. */
+static size_t get_peak_rss() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#if defined(__APPLE__)
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+struct bench_timer_t {
+	using clock_t = std::chrono::steady_clock;
+
+	clock_t::time_point start = clock_t::now();
+
+	double restart() {
+		const clock_t::time_point now = clock_t::now();
+		const double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	}
+};
+
+static void print_json_string(std::ostream& stream, std::string_view str) {
+	stream << '"';
+	for (const char c : str) {
+		if (c == '"' || c == '\\') {
+			stream << '\\' << c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			stream << ' ';
+		} else {
+			stream << c;
+		}
+	}
+	stream << '"';
+}
+
+struct colour_lookup_bench_t {
+	double std_map_ns;
+	double colour_index_map_ns;
+};
+
+/* Compares province colour lookups through a std::map against the map's flat ColourIndexMap, using a shuffled
+ * sequence of province colours with a sprinkling of unrecognised ones. */
+static bool bench_colour_lookup(Map const& map, colour_lookup_bench_t& result) {
+	static constexpr size_t LOOKUP_COUNT = 1 << 22;
+
+	std::map<colour_t, Province::index_t> tree_map;
+	ColourIndexMap<Province::index_t> flat_map { Province::NULL_INDEX };
+	flat_map.reserve(map.get_province_count());
+	for (Province const& province : map.get_provinces()) {
+		tree_map.emplace(province.get_colour(), province.get_index());
+		flat_map.insert(province.get_colour(), province.get_index());
+	}
+	if (tree_map.empty()) {
+		result = { 0.0, 0.0 };
+		return true;
+	}
+
+	std::vector<colour_t> lookups(LOOKUP_COUNT);
+	uint64_t rng = 0x9E3779B97F4A7C15;
+	for (colour_t& colour : lookups) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		colour = (rng & 0xF) == 0 ? static_cast<colour_t>(rng >> 40) & MAX_COLOUR_RGB
+			: map.get_provinces()[(rng >> 8) % map.get_province_count()].get_colour();
+	}
+
+	bench_timer_t timer;
+	uint64_t tree_checksum = 0;
+	for (const colour_t colour : lookups) {
+		const std::map<colour_t, Province::index_t>::const_iterator it = tree_map.find(colour);
+		tree_checksum += it != tree_map.end() ? it->second : Province::NULL_INDEX;
+	}
+	result.std_map_ns = timer.restart() * 1e9 / LOOKUP_COUNT;
+
+	uint64_t flat_checksum = 0;
+	for (const colour_t colour : lookups) {
+		flat_checksum += flat_map.get_index(colour);
+	}
+	result.colour_index_map_ns = timer.restart() * 1e9 / LOOKUP_COUNT;
+
+	if (tree_checksum != flat_checksum) {
+		Logger::error("Colour lookup benchmark mismatch: ", tree_checksum, " vs ", flat_checksum);
+		return false;
+	}
+	return true;
+}
+
+struct mapmode_kernel_bench_t {
+	double colour_func_ns;
+	double kernel_ns;
+};
+
+/* Compares colouring provinces one at a time through each mapmode's type-erased colour function with colouring them
+ * in a single batch through its inlined kernel, averaged per province over every mapmode. */
+static bool bench_mapmode_kernels(Map const& map, mapmode_kernel_bench_t& result) {
+	static constexpr size_t REPEAT_COUNT = 64;
+
+	std::span<const Province> provinces = map.get_provinces();
+	const size_t colour_count = provinces.size() * map.get_mapmode_count() * REPEAT_COUNT;
+	if (colour_count == 0) {
+		result = { 0.0, 0.0 };
+		return true;
+	}
+	std::vector<Mapmode::base_stripe_t> single_colours(provinces.size()), batch_colours(provinces.size());
+
+	bench_timer_t timer;
+	uint64_t single_checksum = 0;
+	for (size_t repeat = 0; repeat < REPEAT_COUNT; ++repeat) {
+		for (Mapmode const& mapmode : map.get_mapmodes()) {
+			for (size_t idx = 0; idx < provinces.size(); ++idx) {
+				single_colours[idx] = mapmode.get_base_stripe_colours(map, provinces[idx]);
+			}
+			single_checksum += single_colours[repeat % provinces.size()];
+		}
+	}
+	result.colour_func_ns = timer.restart() * 1e9 / colour_count;
+
+	uint64_t batch_checksum = 0;
+	for (size_t repeat = 0; repeat < REPEAT_COUNT; ++repeat) {
+		for (Mapmode const& mapmode : map.get_mapmodes()) {
+			mapmode.get_base_stripe_colours(map, provinces, batch_colours.data());
+			batch_checksum += batch_colours[repeat % provinces.size()];
+		}
+	}
+	result.kernel_ns = timer.restart() * 1e9 / colour_count;
+
+	if (single_checksum != batch_checksum) {
+		Logger::error("Mapmode kernel benchmark mismatch: ", single_checksum, " vs ", batch_checksum);
+		return false;
+	}
+	return true;
+}
+
+struct province_query_bench_t {
+	double single_ns;
+	double batch_ns;
+};
+
+/* Compares looking up the province at random points one at a time with looking them all up in a single batch. */
+static bool bench_province_queries(Map const& map, province_query_bench_t& result) {
+	static constexpr size_t QUERY_COUNT = 1 << 20;
+
+	if (map.get_width() == 0 || map.get_height() == 0) {
+		result = { 0.0, 0.0 };
+		return true;
+	}
+
+	std::vector<int32_t> xs(QUERY_COUNT), ys(QUERY_COUNT);
+	uint64_t rng = 0x9E3779B97F4A7C15;
+	for (size_t idx = 0; idx < QUERY_COUNT; ++idx) {
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		xs[idx] = (rng >> 8) % map.get_width();
+		ys[idx] = (rng >> 36) % map.get_height();
+	}
+
+	bench_timer_t timer;
+	uint64_t single_checksum = 0;
+	for (size_t idx = 0; idx < QUERY_COUNT; ++idx) {
+		single_checksum += map.get_province_index_at(xs[idx], ys[idx]);
+	}
+	result.single_ns = timer.restart() * 1e9 / QUERY_COUNT;
+
+	std::vector<Province::index_t> indices(QUERY_COUNT);
+	if (!map.get_province_indices_at(xs, ys, indices)) {
+		return false;
+	}
+	uint64_t batch_checksum = 0;
+	for (const Province::index_t index : indices) {
+		batch_checksum += index;
+	}
+	result.batch_ns = timer.restart() * 1e9 / QUERY_COUNT;
+
+	if (single_checksum != batch_checksum) {
+		Logger::error("Province query benchmark mismatch: ", single_checksum, " vs ", batch_checksum);
+		return false;
+	}
+	return true;
+}
+
+static bool run_bench(Dataloader::path_vector_t const& roots, run_options_t const& options, Timespan::day_t days) {
+	bool ret = true;
+	bench_timer_t total_timer, stage_timer;
+
+	std::vector<std::pair<std::string_view, double>> stages;
+
+	Dataloader dataloader;
+	if (!dataloader.set_roots(roots)) {
+		Logger::error("Failed to set dataloader roots!");
+		ret = false;
+	}
+
+	GameManager game_manager { nullptr };
+	apply_run_options(options, dataloader, game_manager);
+	game_manager.set_fast_forward_refresh_period(GameManager::refresh_period_t::MONTHLY);
+
+	if (!dataloader.load_defines(game_manager)) {
+		Logger::error("Failed to load defines!");
+		ret = false;
+	}
+	stages.emplace_back("load_defines", stage_timer.restart());
+
+	if (!game_manager.load_hardcoded_defines()) {
+		Logger::error("Failed to load hardcoded defines!");
+		ret = false;
+	}
+	stages.emplace_back("load_hardcoded_defines", stage_timer.restart());
+
+	if (!dataloader.load_localisation_files(
+		[](std::string_view /* key */, Dataloader::locale_t /* locale */, std::string_view /* localisation */) -> bool {
 			return true;
 		}
 	)) {
 		Logger::error("Failed to load localisation!");
 		ret = false;
 	}
+	stages.emplace_back("load_localisation", stage_timer.restart());
+
+	std::vector<Bookmark> const& bookmarks = game_manager.get_history_manager().get_bookmark_manager().get_bookmarks();
+	Bookmark const* bookmark = !bookmarks.empty() ? &bookmarks.front() : nullptr;
+	if (bookmark == nullptr) {
+		Logger::error("No bookmark to start the benchmark from!");
+		ret = false;
+	} else if (!game_manager.load_bookmark(bookmark)) {
+		Logger::error("Failed to load bookmark ", bookmark->get_identifier());
+		ret = false;
+	}
+	stages.emplace_back("load_bookmark", stage_timer.restart());
+
+	std::vector<uint8_t> snapshot;
+	game_manager.save_snapshot(snapshot);
+	stages.emplace_back("save_snapshot", stage_timer.restart());
+
+	const Date start_date = game_manager.get_today();
+	double ticks_per_second = 0.0;
+	if (!game_manager.advance_days(days, &ticks_per_second)) {
+		Logger::error("Failed to simulate ", days, " days!");
+		ret = false;
+	}
+	stages.emplace_back("simulate", stage_timer.restart());
+
+	Map const& map = game_manager.get_map();
+	std::vector<uint8_t> mapmode_colours((static_cast<size_t>(Province::MAX_INDEX) + 1) * sizeof(Mapmode::base_stripe_t));
+	std::vector<std::pair<std::string_view, double>> mapmode_times;
+	for (Mapmode::index_t index = 0; index < map.get_mapmode_count(); ++index) {
+		bench_timer_t mapmode_timer;
+		if (!map.generate_mapmode_colours(index, mapmode_colours.data())) {
+			Logger::error("Failed to generate mapmode colours for mapmode ", index);
+			ret = false;
+		}
+		mapmode_times.emplace_back(map.get_mapmode_by_index(index)->get_identifier(), mapmode_timer.restart());
+	}
+	stages.emplace_back("generate_mapmodes", stage_timer.restart());
+
+	/* Nothing has changed since the previous pass, so this only measures copying colours out of the mapmode caches. */
+	for (Mapmode::index_t index = 0; index < map.get_mapmode_count(); ++index) {
+		ret &= map.generate_mapmode_colours(index, mapmode_colours.data());
+	}
+	stages.emplace_back("regenerate_cached_mapmodes", stage_timer.restart());
+
+	colour_lookup_bench_t colour_lookup;
+	ret &= bench_colour_lookup(map, colour_lookup);
+	stages.emplace_back("colour_lookup_bench", stage_timer.restart());
+
+	mapmode_kernel_bench_t mapmode_kernel;
+	ret &= bench_mapmode_kernels(map, mapmode_kernel);
+	stages.emplace_back("mapmode_kernel_bench", stage_timer.restart());
+
+	province_query_bench_t province_query;
+	ret &= bench_province_queries(map, province_query);
+	stages.emplace_back("province_query_bench", stage_timer.restart());
+
+	const Date end_date = game_manager.get_today();
+	if (!game_manager.load_snapshot(snapshot)) {
+		Logger::error("Failed to restore the start state snapshot!");
+		ret = false;
+	}
+	stages.emplace_back("load_snapshot", stage_timer.restart());
+
+	/* Saving the restored state must give back exactly the snapshot it was loaded from, otherwise some value is missed
+	 * by either save_snapshot or load_snapshot. */
+	std::vector<uint8_t> round_trip_snapshot;
+	game_manager.save_snapshot(round_trip_snapshot);
+	const bool snapshot_round_trip = round_trip_snapshot == snapshot;
+	if (!snapshot_round_trip) {
+		const size_t mismatch = std::mismatch(
+			snapshot.begin(), snapshot.end(), round_trip_snapshot.begin(), round_trip_snapshot.end()
+		).first - snapshot.begin();
+		Logger::error(
+			"Snapshot round trip mismatch: saved ", snapshot.size(), " bytes, resaved ", round_trip_snapshot.size(),
+			" bytes, first difference at offset ", mismatch
+		);
+		ret = false;
+	}
+	stages.emplace_back("snapshot_round_trip", stage_timer.restart());
+
+	std::ostream& out = std::cout;
+	out << "{\n\t\"success\": " << (ret ? "true" : "false") << ",\n\t\"threads\": " << options.thread_count
+		<< ",\n\t\"wall_time_s\": " << total_timer.restart() << ",\n\t\"peak_rss_bytes\": " << get_peak_rss()
+		<< ",\n\t\"provinces\": " << map.get_province_count() << ",\n\t\"days_simulated\": " << days
+		<< ",\n\t\"start_date\": \"" << start_date << "\",\n\t\"end_date\": \"" << end_date
+		<< "\",\n\t\"ticks_per_second\": " << ticks_per_second << ",\n\t\"snapshot_bytes\": " << snapshot.size()
+		<< ",\n\t\"snapshot_round_trip\": " << (snapshot_round_trip ? "true" : "false")
+		<< ",\n\t\"shape_image_bytes\": " << map.get_province_shape().get_memory_usage()
+		<< ",\n\t\"colour_lookup_ns\": { \"std_map\": " << colour_lookup.std_map_ns << ", \"colour_index_map\": "
+		<< colour_lookup.colour_index_map_ns << " },\n\t\"mapmode_kernel_ns\": { \"colour_func\": "
+		<< mapmode_kernel.colour_func_ns << ", \"kernel\": " << mapmode_kernel.kernel_ns
+		<< " },\n\t\"province_query_ns\": { \"single\": " << province_query.single_ns << ", \"batch\": "
+		<< province_query.batch_ns << " },\n\t\"stages_s\": {";
+	for (size_t idx = 0; idx < stages.size(); ++idx) {
+		out << (idx > 0 ? ",\n\t\t" : "\n\t\t");
+		print_json_string(out, stages[idx].first);
+		out << ": " << stages[idx].second;
+	}
+	out << "\n\t},\n\t\"mapmodes_s\": {";
+	for (size_t idx = 0; idx < mapmode_times.size(); ++idx) {
+		out << (idx > 0 ? ",\n\t\t" : "\n\t\t");
+		print_json_string(out, mapmode_times[idx].first);
+		out << ": " << mapmode_times[idx].second;
+	}
+	/* Only populated in builds with OPENVIC_SIM_PROFILING defined. */
+	const std::vector<Profiler::phase_stats_t> phases = Profiler::get_phase_stats();
+	out << "\n\t},\n\t\"phases\": [";
+	for (size_t idx = 0; idx < phases.size(); ++idx) {
+		Profiler::phase_stats_t const& phase = phases[idx];
+		out << (idx > 0 ? ",\n\t\t{ \"name\": " : "\n\t\t{ \"name\": ");
+		print_json_string(out, phase.name);
+		out << ", \"calls\": " << phase.call_count << ", \"total_ms\": " << phase.total_ms << ", \"min_ms\": "
+			<< phase.min_ms << ", \"mean_ms\": " << phase.mean_ms << ", \"p99_ms\": " << phase.p99_ms << " }";
+	}
+	out << "\n\t]\n}" << std::endl;
 
 	return ret;
 }
 
-static bool run_headless(Dataloader::path_vector_t const& roots, bool run_tests) {
+static bool run_headless(Dataloader::path_vector_t const& roots, run_options_t const& options, bool run_tests) {
 	bool ret = true;
 
 	Dataloader dataloader;
@@ -53,6 +435,7 @@ static bool run_headless(Dataloader::path_vector_t const& roots, bool run_tests)
 	GameManager game_manager { []() {
 		Logger::info("State updated");
 	} };
+	apply_run_options(options, dataloader, game_manager);
 
 	ret &= headless_load(game_manager, dataloader);
 
@@ -68,7 +451,7 @@ static bool run_headless(Dataloader::path_vector_t const& roots, bool run_tests)
 }
 
 /*
-	$ program [-h] [-t] [-b] [path]+
+	$ program [-h] [-t] [-j <threads>] [--bench <days>] [-c <path>] [--shape-runs] [-b] [path]+
 */
 
 int main(int argc, char const* argv[]) {
@@ -76,9 +459,31 @@ int main(int argc, char const* argv[]) {
 
 	char const* program_name = StringUtils::get_filename(argc > 0 ? argv[0] : nullptr, "<program>");
 	fs::path root;
+	run_options_t options;
 	bool run_tests = false;
+	bool run_benchmark = false;
+	Timespan::day_t bench_days = 0;
 	int argn = 0;
 
+	/* Reads the next argument as a non-negative integer. If reading or converting fails, an error message and the help
+	 * text are displayed, along with returning false to signify the program should exit.
+	 */
+	const auto _read_uint = [&argn, argc, argv, program_name](std::string_view command, uint64_t& value) -> bool {
+		if (++argn < argc) {
+			bool successful = false;
+			value = StringUtils::string_to_uint64(argv[argn], &successful, 10);
+			if (successful) {
+				return true;
+			}
+			std::cerr << "Invalid number \"" << argv[argn] << "\" after command line argument \"" << command << "\"."
+				<< std::endl;
+		} else {
+			std::cerr << "Missing number after command line argument \"" << command << "\"." << std::endl;
+		}
+		print_help(std::cerr, program_name);
+		return false;
+	};
+
 	/* Reads the next argument and converts it to a path via path_transform. If reading or converting fails, an error
 	 * message and the help text are displayed, along with returning false to signify the program should exit.
 	 */
@@ -111,6 +516,28 @@ int main(int argc, char const* argv[]) {
 			return 0;
 		} else if (strcmp(arg, "-t") == 0) {
 			run_tests = true;
+		} else if (strcmp(arg, "-j") == 0) {
+			uint64_t value = 0;
+			if (!_read_uint("-j", value)) {
+				return -1;
+			}
+			options.thread_count = value;
+		} else if (strcmp(arg, "--bench") == 0) {
+			uint64_t value = 0;
+			if (!_read_uint("--bench", value)) {
+				return -1;
+			}
+			run_benchmark = true;
+			bench_days = value;
+		} else if (strcmp(arg, "-c") == 0) {
+			if (++argn >= argc) {
+				std::cerr << "Missing path after map cache command line argument \"-c\"." << std::endl;
+				print_help(std::cerr, program_name);
+				return -1;
+			}
+			options.map_cache_directory = argv[argn];
+		} else if (strcmp(arg, "--shape-runs") == 0) {
+			options.shape_storage = ProvinceShapeImage::storage_t::RUNS;
 		} else if (strcmp(arg, "-b") == 0) {
 			if (!_read("-b", "base directory", std::identity {})) {
 				return -1;
@@ -136,9 +563,15 @@ int main(int argc, char const* argv[]) {
 		roots.emplace_back(root / argv[argn++]);
 	}
 
+	if (run_benchmark) {
+		/* Keep stdout clean for the JSON report, warnings and errors still go to stderr. */
+		Logger::set_info_func([](std::string&& /* str */) {});
+		return run_bench(roots, options, bench_days) ? 0 : -1;
+	}
+
 	std::cout << "!!! HEADLESS SIMULATION START !!!" << std::endl;
 
-	const bool ret = run_headless(roots, run_tests);
+	const bool ret = run_headless(roots, options, run_tests);
 
 	std::cout << "!!! HEADLESS SIMULATION END !!!" << std::endl;
 
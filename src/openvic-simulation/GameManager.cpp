@@ -1,39 +1,90 @@
 #include "GameManager.hpp"
 
+#include <chrono>
+
+#include "openvic-simulation/utility/Profiler.hpp"
+
 using namespace OpenVic;
 
 GameManager::GameManager(state_updated_func_t state_updated_callback)
-	: clock {
+	: map { thread_pool }, clock {
 		[this]() {
 			tick();
 		},
 		[this]() {
 			update_state();
-	} }, state_updated { state_updated_callback } {}
+	} }, state_updated { state_updated_callback }, fast_forward_refresh_period { refresh_period_t::MONTHLY },
+	demographic_defines {} {
+	map.get_pop_store().set_pop_manager(pop_manager);
+}
 
 void GameManager::set_needs_update() {
 	needs_update = true;
 }
 
+void GameManager::_refresh_state() {
+	OV_PROFILE_SCOPE("GameManager::update_state");
+	map.update_state(today);
+	if (state_updated) {
+		state_updated();
+	}
+	needs_update = false;
+}
+
 void GameManager::update_state() {
 	if (!needs_update) {
 		return;
 	}
 	Logger::info("Update: ", today);
-	map.update_state(today);
-	if (state_updated) {
-		state_updated();
+	_refresh_state();
+}
+
+void GameManager::_advance_day() {
+	OV_PROFILE_SCOPE("GameManager::tick");
+	today++;
+	calendar.advance_to(today);
+	if (today.get_day() == 1) {
+		_update_demographics();
+		/* Keeps the number of pops bounded as growth, migration and promotion change their sizes. */
+		map.consolidate_pops();
 	}
-	needs_update = false;
+}
+
+/* Missing defines count as 0, leaving the corresponding part of the update without effect. */
+static fixed_point_t get_define_or_zero(DefineManager const& define_manager, std::string_view identifier) {
+	Define const* define = define_manager.get_define_by_identifier(identifier);
+	if (define == nullptr) {
+		Logger::warning("Missing demographic define ", identifier, ", using 0");
+		return fixed_point_t::_0();
+	}
+	return define->get_value_as_fp();
+}
+
+void GameManager::_setup_demographics() {
+	demographic_defines = {
+		get_define_or_zero(define_manager, "BASE_POPGROWTH"),
+		get_define_or_zero(define_manager, "LIFE_RATING_GROWTH_BONUS"),
+		static_cast<Province::life_rating_t>(get_define_or_zero(define_manager, "MIN_LIFE_RATING_FOR_GROWTH").to_int64_t()),
+		get_define_or_zero(define_manager, "PROMOTION_SCALE"),
+		get_define_or_zero(define_manager, "MIGRATION_SCALE")
+	};
+	ModifierEffect const* population_growth_effect = modifier_manager.get_modifier_effect_by_identifier("population_growth");
+	if (population_growth_effect == nullptr) {
+		Logger::warning("Missing population_growth modifier effect, province modifiers will not affect population growth");
+	}
+	map.set_population_growth_effect(population_growth_effect);
+}
+
+void GameManager::_update_demographics() {
+	map.update_demographics(demographic_defines);
 }
 
 /* REQUIREMENTS:
  * SS-98, SS-101
  */
 void GameManager::tick() {
-	today++;
+	_advance_day();
 	Logger::info("Tick: ", today);
-	map.tick(today);
 	set_needs_update();
 }
 
@@ -41,7 +92,9 @@ bool GameManager::reset() {
 	session_start = time(nullptr);
 	clock.reset();
 	today = {};
+	calendar.reset(today);
 	economy_manager.get_good_manager().reset_to_defaults();
+	_setup_demographics();
 	bool ret = map.reset(economy_manager.get_building_manager());
 	set_needs_update();
 	return ret;
@@ -58,12 +111,128 @@ bool GameManager::load_bookmark(Bookmark const* new_bookmark) {
 		Logger::warning("Bookmark date ", bookmark->get_date(), " is not in the game's time period!");
 	}
 	today = bookmark->get_date();
+	calendar.reset(today);
 	ret &= map.apply_history_to_provinces(history_manager.get_province_manager(), today);
 	// TODO - apply country history
 	// TODO - apply pop history
 	return ret;
 }
 
+/* FNV-1a over each item's identifier, with a zero byte after each one so that the boundaries between identifiers count
+ * too, and a different byte after the whole registry. */
+template<typename T>
+static void add_identifiers_to_fingerprint(uint64_t& fingerprint, std::vector<T> const& items) {
+	constexpr uint64_t FNV_PRIME = 0x100000001B3;
+	const auto mix = [&fingerprint](uint8_t byte) -> void {
+		fingerprint = (fingerprint ^ byte) * FNV_PRIME;
+	};
+	for (T const& item : items) {
+		for (const char c : item.get_identifier()) {
+			mix(static_cast<uint8_t>(c));
+		}
+		mix(0);
+	}
+	mix(0xFF);
+}
+
+uint64_t GameManager::_get_definition_fingerprint() const {
+	uint64_t fingerprint = 0xCBF29CE484222325;
+	add_identifiers_to_fingerprint(fingerprint, history_manager.get_bookmark_manager().get_bookmarks());
+	add_identifiers_to_fingerprint(fingerprint, economy_manager.get_good_manager().get_goods());
+	add_identifiers_to_fingerprint(fingerprint, economy_manager.get_building_manager().get_building_types());
+	add_identifiers_to_fingerprint(fingerprint, country_manager.get_countries());
+	add_identifiers_to_fingerprint(fingerprint, pop_manager.get_pop_types());
+	add_identifiers_to_fingerprint(fingerprint, pop_manager.get_culture_manager().get_cultures());
+	add_identifiers_to_fingerprint(fingerprint, pop_manager.get_religion_manager().get_religions());
+	add_identifiers_to_fingerprint(fingerprint, map.get_terrain_type_manager().get_terrain_types());
+	add_identifiers_to_fingerprint(fingerprint, map.get_provinces());
+	return fingerprint;
+}
+
+void GameManager::save_snapshot(std::vector<uint8_t>& buffer) const {
+	BinaryWriter writer { buffer };
+	writer.write(SNAPSHOT_MAGIC);
+	writer.write(SNAPSHOT_VERSION);
+	writer.write(_get_definition_fingerprint());
+	writer.write(today);
+	writer.write_index(history_manager.get_bookmark_manager().get_bookmarks(), bookmark);
+	economy_manager.get_good_manager().save_snapshot(writer);
+	map.save_snapshot(writer, country_manager, economy_manager.get_good_manager(), pop_manager);
+}
+
+bool GameManager::_read_snapshot_header(BinaryReader& reader) const {
+	uint32_t magic, version;
+	uint64_t fingerprint;
+	if (!reader.read(magic) || !reader.read(version)) {
+		return false;
+	}
+	if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+		Logger::error(
+			"Invalid snapshot header: magic ", magic, ", version ", version, " (expected version ", SNAPSHOT_VERSION, ")"
+		);
+		return false;
+	}
+	if (!reader.read(fingerprint)) {
+		return false;
+	}
+	if (fingerprint != _get_definition_fingerprint()) {
+		Logger::error("Snapshot was saved with different definitions to those currently loaded");
+		return false;
+	}
+	return true;
+}
+
+bool GameManager::_load_snapshot_state(BinaryReader& reader) {
+	Date new_today;
+	Bookmark const* new_bookmark = nullptr;
+	if (!(
+		reader.read(new_today) && reader.read_index(history_manager.get_bookmark_manager().get_bookmarks(), new_bookmark) &&
+		economy_manager.get_good_manager().load_snapshot(reader) &&
+		map.load_snapshot(reader, country_manager, economy_manager.get_good_manager(), pop_manager)
+	)) {
+		return false;
+	}
+	if (!reader.at_end()) {
+		Logger::error("Snapshot has ", reader.get_remaining(), " unexpected trailing bytes");
+		return false;
+	}
+
+	today = new_today;
+	bookmark = new_bookmark;
+	calendar.reset(today);
+	_setup_demographics();
+	for (Province& province : map.get_provinces()) {
+		for (BuildingInstance& building : province.get_buildings()) {
+			const BuildingInstance::ExpansionState state = building.get_expansion_state();
+			if (state == BuildingInstance::ExpansionState::Preparing || state == BuildingInstance::ExpansionState::Expanding) {
+				_schedule_building_expansion(province, building, today + 1);
+			}
+		}
+	}
+	_refresh_state();
+	return true;
+}
+
+bool GameManager::load_snapshot(std::span<const uint8_t> data) {
+	BinaryReader reader { data };
+	if (!_read_snapshot_header(reader)) {
+		return false;
+	}
+	/* Reading overwrites the world as it goes, so the current state is kept to roll back to if the rest of the snapshot
+	 * turns out to be invalid. */
+	std::vector<uint8_t> backup;
+	save_snapshot(backup);
+	if (_load_snapshot_state(reader)) {
+		return true;
+	}
+	Logger::error("Failed to load snapshot, restoring the previous game state");
+	BinaryReader backup_reader { backup };
+	if (!(_read_snapshot_header(backup_reader) && _load_snapshot_state(backup_reader))) {
+		Logger::error("Failed to restore the previous game state after loading an invalid snapshot");
+	}
+	return false;
+}
+
 bool GameManager::expand_building(Province::index_t province_index, std::string_view building_type_identifier) {
 	set_needs_update();
 	Province* province = map.get_province_by_index(province_index);
@@ -71,7 +240,76 @@ bool GameManager::expand_building(Province::index_t province_index, std::string_
 		Logger::error("Invalid province index ", province_index, " while trying to expand building ", building_type_identifier);
 		return false;
 	}
-	return province->expand_building(building_type_identifier);
+	if (!province->expand_building(building_type_identifier, today)) {
+		return false;
+	}
+	BuildingInstance* building = province->get_building_by_identifier(building_type_identifier);
+	_schedule_building_expansion(*province, *building, today + 1);
+	return true;
+}
+
+void GameManager::_schedule_building_expansion(Province& province, BuildingInstance& building, Date date) {
+	calendar.schedule(date, [this, &province, &building](Date today) -> void {
+		building.start_expansion();
+		if (building.finish_expansion(today)) {
+			province.mark_dirty();
+		} else if (building.get_expansion_state() == BuildingInstance::ExpansionState::Expanding) {
+			_schedule_building_expansion(province, building, building.get_end_date());
+		}
+	});
+}
+
+bool GameManager::advance_days(Timespan::day_t days, double* ticks_per_second) {
+	if (days < 0) {
+		Logger::error("Cannot advance the game by a negative number of days: ", days);
+		return false;
+	}
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	const Date start_date = today;
+
+	for (Timespan::day_t day = 0; day < days; ++day) {
+		_advance_day();
+		set_needs_update();
+		switch (fast_forward_refresh_period) {
+		case refresh_period_t::DAILY:
+			_refresh_state();
+			break;
+		case refresh_period_t::MONTHLY:
+			if (today.get_day() == 1) {
+				_refresh_state();
+			}
+			break;
+		case refresh_period_t::YEARLY:
+			if (today.get_day() == 1 && today.get_month() == 1) {
+				_refresh_state();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if (needs_update) {
+		_refresh_state();
+	}
+
+	const double seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	const double rate = seconds > 0.0 ? static_cast<double>(days) / seconds : 0.0;
+	Logger::info(
+		"Advanced ", days, " days from ", start_date, " to ", today, " in ", seconds, " seconds (", rate, " ticks per second)"
+	);
+	if (ticks_per_second != nullptr) {
+		*ticks_per_second = rate;
+	}
+	return true;
+}
+
+bool GameManager::advance_until(Date date, double* ticks_per_second) {
+	if (date < today) {
+		Logger::error("Cannot advance the game backwards from ", today, " to ", date);
+		return false;
+	}
+	return advance_days(static_cast<Timespan::day_t>(date - today), ticks_per_second);
 }
 
 static constexpr colour_t ALPHA_VALUE = float_to_alpha_value(0.5f);
@@ -103,16 +341,24 @@ static constexpr auto get_colour_mapmode(T const*(Province::*get_item)() const)
 	};
 }
 
+/* For values held in the map's ProvinceState columns, read directly rather than through the province. */
 template<std::derived_from<HasColour> T>
-static constexpr Mapmode::base_stripe_t shaded_mapmode(fixed_point_map_t<T const*> const& map) {
-	const std::pair<fixed_point_map_const_iterator_t<T const*>, fixed_point_map_const_iterator_t<T const*>> largest =
-		get_largest_two_items(map);
-	if (largest.first != map.end()) {
-		const colour_t base_colour = ALPHA_VALUE | largest.first->first->get_colour();
-		if (largest.second != map.end()) {
+static constexpr auto get_colour_mapmode(T const*(ProvinceState::*get_item)(Province::index_t) const) {
+	return [get_item](Map const& map, Province const& province) -> Mapmode::base_stripe_t {
+		T const* item = (map.get_province_state().*get_item)(province.get_index());
+		return item != nullptr ? make_solid_base_stripe(ALPHA_VALUE | item->get_colour()) : NULL_COLOUR;
+	};
+}
+
+template<std::derived_from<HasColour> T>
+static constexpr Mapmode::base_stripe_t shaded_mapmode(IndexedFixedPointMap<T> const& map) {
+	const std::pair<size_t, size_t> largest = get_largest_two_items(map);
+	if (largest.first < map.size()) {
+		const colour_t base_colour = ALPHA_VALUE | map.get_key(largest.first).get_colour();
+		if (largest.second < map.size()) {
 			/* If second largest is at least a third... */
-			if (largest.second->second * 3 >= get_total(map)) {
-				const colour_t stripe_colour = ALPHA_VALUE | largest.second->first->get_colour();
+			if (map[largest.second] * 3 >= get_total(map)) {
+				const colour_t stripe_colour = ALPHA_VALUE | map.get_key(largest.second).get_colour();
 				return combine_base_stripe(base_colour, stripe_colour);
 			}
 		}
@@ -122,7 +368,7 @@ static constexpr Mapmode::base_stripe_t shaded_mapmode(fixed_point_map_t<T const
 }
 
 template<std::derived_from<HasColour> T>
-static constexpr auto shaded_mapmode(fixed_point_map_t<T const*> const&(Province::*get_map)() const) {
+static constexpr auto shaded_mapmode(IndexedFixedPointMap<T> const&(Province::*get_map)() const) {
 	return [get_map](Map const& map, Province const& province) -> Mapmode::base_stripe_t {
 		return shaded_mapmode((province.*get_map)());
 	};
@@ -131,83 +377,74 @@ static constexpr auto shaded_mapmode(fixed_point_map_t<T const*> const&(Province
 bool GameManager::load_hardcoded_defines() {
 	bool ret = true;
 
-	using mapmode_t = std::pair<std::string, Mapmode::colour_func_t>;
-	const std::vector<mapmode_t> mapmodes {
-		{
-			"mapmode_terrain",
-			[](Map const&, Province const& province) -> Mapmode::base_stripe_t {
-				return NULL_COLOUR;
-			}
+	/* The hardcoded mapmodes are added with their kernel types rather than as Mapmode::colour_func_t, so their colour
+	 * calculations are inlined into the loop over provinces. */
+	ret &= map.add_mapmode(
+		"mapmode_terrain",
+		[](Map const&, Province const& province) -> Mapmode::base_stripe_t {
+			return NULL_COLOUR;
 		},
-		{
-			"mapmode_political", get_colour_mapmode(&Province::get_owner)
-		},
-		{
-			"mapmode_province",
-			make_solid_base_stripe_func([](Map const&, Province const& province) -> colour_t {
-				return ALPHA_VALUE | province.get_colour();
-			})
-		},
-		{
-			"mapmode_region", get_colour_mapmode(&Province::get_region)
-		},
-		{
-			"mapmode_index",
-			make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
-				const colour_t f = fraction_to_colour_byte(province.get_index(), map.get_province_count() + 1);
-				return ALPHA_VALUE | (f << 16) | (f << 8) | f;
-			})
-		},
-		{
-			"mapmode_terrain_type", get_colour_mapmode(&Province::get_terrain_type)
-		},
-		{
-			"mapmode_rgo", get_colour_mapmode(&Province::get_rgo)
-		},
-		{
-			"mapmode_infrastructure",
-			make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
-				BuildingInstance const* railroad = province.get_building_by_identifier("railroad");
-				if (railroad != nullptr) {
-					colour_t val = fraction_to_colour_byte(railroad->get_level(),
-						railroad->get_building_type().get_max_level() + 1, 0.5f, 1.0f);
-					switch (railroad->get_expansion_state()) {
-					case BuildingInstance::ExpansionState::CannotExpand:
-						val <<= 16;
-						break;
-					case BuildingInstance::ExpansionState::CanExpand:
-						break;
-					default:
-						val <<= 8;
-						break;
-					}
-					return ALPHA_VALUE | val;
+		false
+	);
+	ret &= map.add_mapmode("mapmode_political", get_colour_mapmode(&ProvinceState::get_owner), false);
+	ret &= map.add_mapmode(
+		"mapmode_province",
+		make_solid_base_stripe_func([](Map const&, Province const& province) -> colour_t {
+			return ALPHA_VALUE | province.get_colour();
+		}),
+		false
+	);
+	ret &= map.add_mapmode("mapmode_region", get_colour_mapmode(&Province::get_region), false);
+	ret &= map.add_mapmode(
+		"mapmode_index",
+		make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
+			const colour_t f = fraction_to_colour_byte(province.get_index(), map.get_province_count() + 1);
+			return ALPHA_VALUE | (f << 16) | (f << 8) | f;
+		}),
+		false
+	);
+	ret &= map.add_mapmode("mapmode_terrain_type", get_colour_mapmode(&Province::get_terrain_type), false);
+	ret &= map.add_mapmode("mapmode_rgo", get_colour_mapmode(&ProvinceState::get_rgo), false);
+	ret &= map.add_mapmode(
+		"mapmode_infrastructure",
+		make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
+			BuildingInstance const* railroad = province.get_building_by_identifier("railroad");
+			if (railroad != nullptr) {
+				colour_t val = fraction_to_colour_byte(railroad->get_level(),
+					railroad->get_building_type().get_max_level() + 1, 0.5f, 1.0f);
+				switch (railroad->get_expansion_state()) {
+				case BuildingInstance::ExpansionState::CannotExpand:
+					val <<= 16;
+					break;
+				case BuildingInstance::ExpansionState::CanExpand:
+					break;
+				default:
+					val <<= 8;
+					break;
 				}
-				return NULL_COLOUR;
-			})
-		},
-		{
-			"mapmode_population",
-			make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
-				// TODO - explore non-linear scaling to have more variation among non-massive provinces
-				// TODO - when selecting a province, only show the population of provinces controlled (or owned?)
-				// by the same country, relative to the most populous province in that set of provinces
-				return ALPHA_VALUE | (fraction_to_colour_byte(
-					province.get_total_population(), map.get_highest_province_population() + 1, 0.1f, 1.0f
-				) << 8);
-			})
-		},
-		{
-			"mapmode_culture", shaded_mapmode(&Province::get_culture_distribution)
-		},
-		{
-			"mapmode_religion", shaded_mapmode(&Province::get_religion_distribution)
-		}
-	};
+				return ALPHA_VALUE | val;
+			}
+			return NULL_COLOUR;
+		}),
+		false
+	);
+	/* Scaled by the highest province population, so it depends on the whole map. */
+	ret &= map.add_mapmode(
+		"mapmode_population",
+		make_solid_base_stripe_func([](Map const& map, Province const& province) -> colour_t {
+			// TODO - explore non-linear scaling to have more variation among non-massive provinces
+			// TODO - when selecting a province, only show the population of provinces controlled (or owned?)
+			// by the same country, relative to the most populous province in that set of provinces
+			return ALPHA_VALUE | (fraction_to_colour_byte(
+				map.get_province_state().get_total_population(province.get_index()),
+				map.get_highest_province_population() + 1, 0.1f, 1.0f
+			) << 8);
+		}),
+		true
+	);
+	ret &= map.add_mapmode("mapmode_culture", shaded_mapmode(&Province::get_culture_distribution), false);
+	ret &= map.add_mapmode("mapmode_religion", shaded_mapmode(&Province::get_religion_distribution), false);
 
-	for (mapmode_t const& mapmode : mapmodes) {
-		ret &= map.add_mapmode(mapmode.first, mapmode.second);
-	}
 	map.lock_mapmodes();
 
 	return ret;
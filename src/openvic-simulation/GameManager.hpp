@@ -9,13 +9,21 @@
 #include "openvic-simulation/map/Map.hpp"
 #include "openvic-simulation/military/MilitaryManager.hpp"
 #include "openvic-simulation/misc/Define.hpp"
+#include "openvic-simulation/misc/EventCalendar.hpp"
 #include "openvic-simulation/politics/PoliticsManager.hpp"
+#include "openvic-simulation/utility/ThreadPool.hpp"
 
 namespace OpenVic {
 	struct GameManager {
 		using state_updated_func_t = std::function<void()>;
 
+		/* How often the game state is refreshed while fast-forwarding with advance_days or advance_until. The state is
+		 * always refreshed once fast-forwarding finishes, so END_ONLY skips all intermediate refreshes. */
+		enum class refresh_period_t { DAILY, MONTHLY, YEARLY, END_ONLY };
+
 	private:
+		/* Declared first so that it outlives every manager which may run work on it. */
+		ThreadPool thread_pool;
 		Map map;
 		DefineManager define_manager;
 		EconomyManager economy_manager;
@@ -26,6 +34,7 @@ namespace OpenVic {
 		PopManager pop_manager;
 		CountryManager country_manager;
 		UIManager ui_manager;
+		EventCalendar calendar;
 		GameAdvancementHook clock;
 
 		time_t session_start; /* SS-54, as well as allowing time-tracking */
@@ -33,14 +42,40 @@ namespace OpenVic {
 		Date PROPERTY(today);
 		state_updated_func_t state_updated;
 		bool needs_update;
+		refresh_period_t PROPERTY_RW(fast_forward_refresh_period);
+		Map::demographic_defines_t demographic_defines;
 
 		void set_needs_update();
+		void _refresh_state();
 		void update_state();
+		void _advance_day();
+		/* Looks up the demographic defines and the population growth modifier effect, so that they are only resolved
+		 * (and missing ones only reported) once per game rather than every month. */
+		void _setup_demographics();
+		/* Runs the monthly demographic update with the constants from the loaded defines. */
+		void _update_demographics();
 		void tick();
 
+		/* Schedules the next step of a building's expansion on the calendar: moving from preparing to expanding on date,
+		 * then completing on its end date, which raises its level and marks its province dirty. Nothing runs in
+		 * between, as expansion progress is worked out from the dates when read. */
+		void _schedule_building_expansion(Province& province, BuildingInstance& building, Date date);
+
+		static constexpr uint32_t SNAPSHOT_MAGIC = 0x5353564F; /* "OVSS" */
+		static constexpr uint32_t SNAPSHOT_VERSION = 4;
+
+		/* A hash of the identifiers, in order, of every registry snapshots refer to by index, so snapshots are only
+		 * loaded into the definitions they were saved with. */
+		uint64_t _get_definition_fingerprint() const;
+		/* Checks a snapshot's magic number, version and definition fingerprint. */
+		bool _read_snapshot_header(BinaryReader& reader) const;
+		/* Reads the rest of a snapshot over the current state, which is left partly overwritten if this fails. */
+		bool _load_snapshot_state(BinaryReader& reader);
+
 	public:
 		GameManager(state_updated_func_t state_updated_callback);
 
+		REF_GETTERS(thread_pool)
 		REF_GETTERS(map)
 		REF_GETTERS(define_manager)
 		REF_GETTERS(economy_manager)
@@ -51,13 +86,32 @@ namespace OpenVic {
 		REF_GETTERS(pop_manager)
 		REF_GETTERS(country_manager)
 		REF_GETTERS(ui_manager)
+		REF_GETTERS(calendar)
 		REF_GETTERS(clock)
 
 		bool reset();
 		bool load_bookmark(Bookmark const* new_bookmark);
 
+		/* Appends a binary snapshot of the mutable game state (today's date, good prices and every province's history
+		 * values, buildings and pops) to buffer. Definitions are referred to by registry index, so a snapshot can only be
+		 * loaded into a GameManager with the same game data loaded, typically the one it was saved from. This allows many
+		 * runs to branch from one loaded start state without reapplying history each time. */
+		void save_snapshot(std::vector<uint8_t>& buffer) const;
+		/* Restores the state saved by save_snapshot and refreshes the game state. Pending calendar events are replaced by
+		 * the events of the snapshot's ongoing building expansions. Snapshots saved with different definitions are
+		 * rejected. Loading is all or nothing: the current state is saved first and restored if the snapshot turns out
+		 * to be invalid part way through, so a failed load leaves the game exactly as it was. */
+		bool load_snapshot(std::span<const uint8_t> data);
+
 		bool expand_building(Province::index_t province_index, std::string_view building_type_identifier);
 
+		/* Runs the given number of ticks back to back, ignoring the clock's speed and pause state and skipping per-tick
+		 * logging, refreshing the state according to fast_forward_refresh_period. If ticks_per_second is non-null, the
+		 * achieved simulation rate is written to it. */
+		bool advance_days(Timespan::day_t days, double* ticks_per_second = nullptr);
+		/* Fast-forwards as with advance_days until today is the given date. */
+		bool advance_until(Date date, double* ticks_per_second = nullptr);
+
 		/* Hardcoded data for defining things for which parsing from files has
 		 * not been implemented, currently mapmodes and building types.
 		 */
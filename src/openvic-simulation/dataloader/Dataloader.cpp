@@ -1,9 +1,12 @@
 #include "Dataloader.hpp"
 
 #include <array>
+#include <bit>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <optional>
+#include <span>
 #include <string_view>
 #include <system_error>
 #include <type_traits>
@@ -19,6 +22,8 @@
 #include "openvic-simulation/GameManager.hpp"
 #include "openvic-simulation/utility/ConstexprIntToStr.hpp"
 #include "openvic-simulation/utility/Logger.hpp"
+#include "openvic-simulation/utility/MappedFile.hpp"
+#include "openvic-simulation/utility/Profiler.hpp"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -579,6 +584,7 @@ csv::Windows1252Parser Dataloader::parse_csv(fs::path const& path) {
 }
 
 bool Dataloader::_load_interface_files(UIManager& ui_manager) const {
+	OV_PROFILE_SCOPE("Dataloader::_load_interface_files");
 	static constexpr std::string_view interface_directory = "interface/";
 
 	bool ret = apply_to_files(
@@ -611,6 +617,7 @@ bool Dataloader::_load_interface_files(UIManager& ui_manager) const {
 bool Dataloader::_load_pop_types(
 	PopManager& pop_manager, UnitManager const& unit_manager, GoodManager const& good_manager
 ) const {
+	OV_PROFILE_SCOPE("Dataloader::_load_pop_types");
 	static constexpr std::string_view pop_type_directory = "poptypes";
 	const bool ret = apply_to_files(
 		lookup_files_in_dir(pop_type_directory, ".txt"),
@@ -625,6 +632,7 @@ bool Dataloader::_load_pop_types(
 }
 
 bool Dataloader::_load_units(UnitManager& unit_manager, GoodManager const& good_manager) const {
+	OV_PROFILE_SCOPE("Dataloader::_load_units");
 	static constexpr std::string_view units_directory = "units";
 	const bool ret = apply_to_files(
 		lookup_files_in_dir(units_directory, ".txt"),
@@ -637,6 +645,7 @@ bool Dataloader::_load_units(UnitManager& unit_manager, GoodManager const& good_
 }
 
 bool Dataloader::_load_history(GameManager& game_manager, bool unused_history_file_warnings) const {
+	OV_PROFILE_SCOPE("Dataloader::_load_history");
 
 	/* Country History */
 	static constexpr std::string_view country_history_directory = "history/countries";
@@ -711,7 +720,43 @@ bool Dataloader::_load_history(GameManager& game_manager, bool unused_history_fi
 	return ret;
 }
 
+/* Mixes the contents of a file into hash, a word at a time across four independent lanes so hashing large images runs
+ * at memory speed. Only used to detect changed files, so it doesn't need to resist deliberate collisions. */
+static bool hash_file_contents(fs::path const& path, uint64_t& hash) {
+	static constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87, PRIME_2 = 0xC2B2AE3D27D4EB4F;
+	static constexpr auto mix = [](uint64_t lane, uint64_t word) -> uint64_t {
+		return std::rotl(lane + word * PRIME_2, 31) * PRIME_1;
+	};
+
+	MappedFile file;
+	if (!file.open(path)) {
+		return false;
+	}
+	const std::span<const uint8_t> data = file.get_data();
+	std::array<uint64_t, 4> lanes { hash + PRIME_1, hash + PRIME_2, hash, hash - PRIME_1 };
+	size_t offset = 0;
+	for (; offset + sizeof(uint64_t) * lanes.size() <= data.size(); offset += sizeof(uint64_t) * lanes.size()) {
+		for (size_t lane = 0; lane < lanes.size(); ++lane) {
+			uint64_t word;
+			std::memcpy(&word, data.data() + offset + lane * sizeof(uint64_t), sizeof(word));
+			lanes[lane] = mix(lanes[lane], word);
+		}
+	}
+	uint64_t tail = 0;
+	for (; offset < data.size(); ++offset) {
+		tail = (tail << 8) | data[offset];
+		if ((offset & 7) == 7) {
+			lanes[0] = mix(lanes[0], tail);
+			tail = 0;
+		}
+	}
+	hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+	hash = mix(mix(hash, tail), data.size());
+	return true;
+}
+
 bool Dataloader::_load_map_dir(GameManager& game_manager) const {
+	OV_PROFILE_SCOPE("Dataloader::_load_map_dir");
 	static constexpr std::string_view map_directory = "map/";
 	Map& map = game_manager.get_map();
 
@@ -814,25 +859,54 @@ bool Dataloader::_load_map_dir(GameManager& game_manager) const {
 		ret = false;
 	}
 
-	if (!map.load_map_images(
-		lookup_file(append_string_views(map_directory, provinces)),
-		lookup_file(append_string_views(map_directory, terrain)), false
-	)) {
+	const fs::path provinces_path = lookup_file(append_string_views(map_directory, provinces));
+	const fs::path terrain_path = lookup_file(append_string_views(map_directory, terrain));
+	const fs::path adjacencies_path = lookup_file(append_string_views(map_directory, adjacencies));
+
+	fs::path cache_path;
+	uint64_t cache_key = 0;
+	if (!map_cache_directory.empty()) {
+		/* Everything the cached data is derived from. Terrain definitions decide the terrain mapping of each image byte. */
+		const fs::path source_paths[] {
+			lookup_file(append_string_views(map_directory, definitions)), provinces_path, terrain_path, adjacencies_path,
+			lookup_file(append_string_views(map_directory, terrain_definition))
+		};
+		bool hashed = true;
+		for (fs::path const& source_path : source_paths) {
+			hashed &= hash_file_contents(source_path, cache_key);
+		}
+		if (hashed) {
+			cache_path = map_cache_directory / "map.cache";
+		} else {
+			Logger::warning("Failed to hash map source files, not using the map cache");
+		}
+	}
+
+	if (!cache_path.empty() && map.load_map_cache(cache_path, cache_key)) {
+		return ret;
+	}
+
+	bool map_loaded = true;
+	if (!map.load_map_images(provinces_path, terrain_path, false)) {
 		Logger::error("Failed to load map images!");
-		ret = false;
+		map_loaded = false;
 	}
 
-	if (!map.generate_and_load_province_adjacencies(
-		parse_csv(lookup_file(append_string_views(map_directory, adjacencies))).get_lines()
-	)) {
+	if (!map.generate_and_load_province_adjacencies(parse_csv(adjacencies_path).get_lines())) {
 		Logger::error("Failed to generate and load province adjacencies!");
-		ret = false;
+		map_loaded = false;
 	}
 
-	return ret;
+	if (map_loaded && !cache_path.empty()) {
+		/* A missing cache only costs startup time, so failing to write one isn't a load failure. */
+		map.save_map_cache(cache_path, cache_key);
+	}
+
+	return ret && map_loaded;
 }
 
 bool Dataloader::load_defines(GameManager& game_manager) const {
+	OV_PROFILE_SCOPE("Dataloader::load_defines");
 	static const std::string defines_file = "common/defines.lua";
 	static const std::string buildings_file = "common/buildings.txt";
 	static const std::string bookmark_file = "common/bookmarks.txt";
@@ -1038,6 +1112,7 @@ static bool _load_localisation_file(Dataloader::localisation_callback_t callback
 }
 
 bool Dataloader::load_localisation_files(localisation_callback_t callback, std::string_view localisation_dir) const {
+	OV_PROFILE_SCOPE("Dataloader::load_localisation_files");
 	return apply_to_files(
 		lookup_files_in_dir(localisation_dir, ".csv"),
 		[callback](fs::path path) -> bool {
@@ -23,6 +23,8 @@ namespace OpenVic {
 
 	private:
 		path_vector_t roots;
+		/* Where to keep the map cache, see Map::save_map_cache. Caching is disabled if this is empty. */
+		fs::path PROPERTY_RW(map_cache_directory);
 
 		bool _load_interface_files(UIManager& ui_manager) const;
 		bool _load_pop_types(PopManager& pop_manager, UnitManager const& unit_manager, GoodManager const& good_manager) const;
@@ -1,5 +1,7 @@
 #include "BuildingInstance.hpp"
 
+#include <algorithm>
+
 using namespace OpenVic;
 
 BuildingInstance::BuildingInstance(BuildingType const& new_building_type, level_t new_level)
@@ -10,10 +12,12 @@ bool BuildingInstance::_can_expand() const {
 	return level < building_type.get_max_level();
 }
 
-bool BuildingInstance::expand() {
+bool BuildingInstance::expand(Date today) {
 	if (expansion_state == ExpansionState::CanExpand) {
 		expansion_state = ExpansionState::Preparing;
-		expansion_progress = 0.0f;
+		/* The dates are fixed immediately so the completion can be scheduled before the next state update. */
+		start_date = today;
+		end_date = start_date + building_type.get_build_time();
 		return true;
 	}
 	return false;
@@ -22,27 +26,48 @@ bool BuildingInstance::expand() {
 /* REQUIREMENTS:
  * MAP-71, MAP-74, MAP-77
  */
-void BuildingInstance::update_state(Date today) {
+void BuildingInstance::update_state(Date /* today */) {
 	switch (expansion_state) {
 	case ExpansionState::Preparing:
-		start_date = today;
-		end_date = start_date + building_type.get_build_time();
-		break;
 	case ExpansionState::Expanding:
-		expansion_progress = static_cast<double>(today - start_date) / static_cast<double>(end_date - start_date);
 		break;
 	default: expansion_state = _can_expand() ? ExpansionState::CanExpand : ExpansionState::CannotExpand;
 	}
 }
 
-void BuildingInstance::tick(Date today) {
-	if (expansion_state == ExpansionState::Preparing) {
-		expansion_state = ExpansionState::Expanding;
+float BuildingInstance::get_expansion_progress(Date today) const {
+	if (expansion_state != ExpansionState::Expanding || end_date <= start_date) {
+		return 0.0f;
 	}
-	if (expansion_state == ExpansionState::Expanding) {
-		if (end_date <= today) {
-			level++;
-			expansion_state = ExpansionState::CannotExpand;
-		}
+	const double progress = static_cast<double>(today - start_date) / static_cast<double>(end_date - start_date);
+	return static_cast<float>(std::clamp(progress, 0.0, 1.0));
+}
+
+bool BuildingInstance::start_expansion() {
+	if (expansion_state != ExpansionState::Preparing) {
+		return false;
 	}
+	expansion_state = ExpansionState::Expanding;
+	return true;
+}
+
+bool BuildingInstance::finish_expansion(Date today) {
+	if (expansion_state != ExpansionState::Expanding || today < end_date) {
+		return false;
+	}
+	level++;
+	expansion_state = ExpansionState::CannotExpand;
+	return true;
+}
+
+void BuildingInstance::save_snapshot(BinaryWriter& writer) const {
+	writer.write(level);
+	writer.write(expansion_state);
+	writer.write(start_date);
+	writer.write(end_date);
+}
+
+bool BuildingInstance::load_snapshot(BinaryReader& reader) {
+	return reader.read(level) && reader.read_enum(expansion_state, ExpansionState::Expanding) && reader.read(start_date) &&
+		reader.read(end_date);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "openvic-simulation/economy/BuildingType.hpp"
+#include "openvic-simulation/utility/BinaryStream.hpp"
 
 namespace OpenVic {
 
@@ -16,7 +17,6 @@ namespace OpenVic {
 		ExpansionState PROPERTY(expansion_state);
 		Date PROPERTY(start_date)
 		Date PROPERTY(end_date);
-		float PROPERTY(expansion_progress);
 
 		bool _can_expand() const;
 
@@ -24,8 +24,18 @@ namespace OpenVic {
 		BuildingInstance(BuildingType const& new_building_type, level_t new_level = 0);
 		BuildingInstance(BuildingInstance&&) = default;
 
-		bool expand();
+		bool expand(Date today);
 		void update_state(Date today);
-		void tick(Date today);
+		/* The fraction of an ongoing expansion done by today, worked out from its dates when asked rather than stored, so
+		 * expanding buildings need no daily updates. 0 unless expanding. */
+		float get_expansion_progress(Date today) const;
+		/* Moves a preparing expansion on to expanding. Returns false if the building wasn't preparing. */
+		bool start_expansion();
+		/* Completes an expansion whose end date is on or before today, raising the level. Returns false if the building
+		 * wasn't expanding or its expansion isn't due yet. */
+		bool finish_expansion(Date today);
+
+		void save_snapshot(BinaryWriter& writer) const;
+		bool load_snapshot(BinaryReader& reader);
 	};
 }
@@ -59,6 +59,31 @@ void GoodManager::reset_to_defaults() {
 	}
 }
 
+void GoodManager::save_snapshot(BinaryWriter& writer) const {
+	writer.write<uint32_t>(goods.size());
+	for (Good const& good : goods.get_items()) {
+		writer.write(good.price);
+		writer.write(good.available);
+	}
+}
+
+bool GoodManager::load_snapshot(BinaryReader& reader) {
+	uint32_t good_count;
+	if (!reader.read(good_count)) {
+		return false;
+	}
+	if (good_count != goods.size()) {
+		Logger::error("Snapshot has ", good_count, " goods, expected ", goods.size());
+		return false;
+	}
+	for (Good& good : goods.get_items()) {
+		if (!reader.read(good.price) || !reader.read_bool(good.available)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 bool GoodManager::load_goods_file(ast::NodeCPtr root) {
 	size_t total_expected_goods = 0;
 	bool ret = expect_dictionary_reserve_length(
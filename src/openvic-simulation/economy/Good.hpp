@@ -1,6 +1,7 @@
 #pragma once
 
 #include "openvic-simulation/types/IdentifierRegistry.hpp"
+#include "openvic-simulation/utility/BinaryStream.hpp"
 
 namespace OpenVic {
 	struct GoodManager;
@@ -74,6 +75,9 @@ namespace OpenVic {
 		IDENTIFIER_REGISTRY_ACCESSORS(good)
 
 		void reset_to_defaults();
+		/* Snapshots hold the current price and availability of every good, in registry order. */
+		void save_snapshot(BinaryWriter& writer) const;
+		bool load_snapshot(BinaryReader& reader);
 		bool load_goods_file(ast::NodeCPtr root);
 	};
 }
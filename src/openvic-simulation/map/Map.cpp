@@ -1,31 +1,63 @@
 #include "Map.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cstring>
+#include <fstream>
 #include <unordered_set>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OPENVIC_MAP_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 #include "openvic-simulation/economy/Good.hpp"
 #include "openvic-simulation/history/ProvinceHistory.hpp"
 #include "openvic-simulation/utility/BMP.hpp"
 #include "openvic-simulation/utility/Logger.hpp"
+#include "openvic-simulation/utility/MappedFile.hpp"
+#include "openvic-simulation/utility/Profiler.hpp"
+#include "openvic-simulation/utility/StringUtils.hpp"
 
 using namespace OpenVic;
 using namespace OpenVic::NodeTools;
 
 Mapmode::Mapmode(
-	std::string_view new_identifier, index_t new_index, colour_func_t new_colour_func
-) : HasIdentifier { new_identifier }, index { new_index }, colour_func { new_colour_func } {
+	std::string_view new_identifier, index_t new_index, colour_func_t&& new_colour_func, batch_func_t&& new_batch_func,
+	bool new_uses_map_state, bool new_thread_safe
+) : HasIdentifier { new_identifier }, index { new_index }, colour_func { std::move(new_colour_func) },
+	batch_func { std::move(new_batch_func) }, uses_map_state { new_uses_map_state }, thread_safe { new_thread_safe } {
 	assert(colour_func != nullptr);
 }
 
 const Mapmode Mapmode::ERROR_MAPMODE {
-	"mapmode_error", 0, [](Map const& map, Province const& province) -> colour_t { return 0xFFFF0000; }
+	"mapmode_error", 0, [](Map const& map, Province const& province) -> colour_t { return 0xFFFF0000; }, nullptr, false,
+	true
 };
 
 Mapmode::base_stripe_t Mapmode::get_base_stripe_colours(Map const& map, Province const& province) const {
 	return colour_func ? colour_func(map, province) : NULL_COLOUR;
 }
 
-Map::Map() : provinces { "provinces" }, regions { "regions" }, mapmodes { "mapmodes" } {}
+void Mapmode::get_base_stripe_colours(Map const& map, std::span<const Province> provinces, base_stripe_t* target) const {
+	if (batch_func) {
+		batch_func(map, provinces, target);
+	} else {
+		for (Province const& province : provinces) {
+			*target++ = get_base_stripe_colours(map, province);
+		}
+	}
+}
+
+Map::Map(ThreadPool& new_thread_pool)
+	: thread_pool { new_thread_pool }, provinces { "provinces" }, regions { "regions" }, mapmodes { "mapmodes" },
+	province_shape_storage { ProvinceShapeImage::storage_t::RAW },
+	population_growth_effect { nullptr }, pathfinder { *this, new_thread_pool } {}
 
 bool Map::add_province(std::string_view identifier, colour_t colour) {
 	if (provinces.size() >= max_provinces) {
@@ -49,7 +81,7 @@ bool Map::add_province(std::string_view identifier, colour_t colour) {
 		Logger::error("Invalid province colour for ", identifier, ": ", colour_to_hex_string(colour));
 		return false;
 	}
-	Province new_province { identifier, colour, static_cast<Province::index_t>(provinces.size() + 1) };
+	Province new_province { identifier, colour, static_cast<Province::index_t>(provinces.size() + 1), *this };
 	const Province::index_t index = get_index_from_colour(colour);
 	if (index != Province::NULL_INDEX) {
 		Logger::error(
@@ -57,8 +89,12 @@ bool Map::add_province(std::string_view identifier, colour_t colour) {
 		);
 		return false;
 	}
-	colour_index_map[new_province.get_colour()] = new_province.get_index();
-	return provinces.add_item(std::move(new_province));
+	const Province::index_t new_index = new_province.get_index();
+	if (!provinces.add_item(std::move(new_province))) {
+		return false;
+	}
+	province_state.add_province();
+	return colour_index_map.insert(colour, new_index);
 }
 
 bool Map::set_water_province(std::string_view identifier) {
@@ -151,20 +187,31 @@ Province const* Map::get_province_by_index(Province::index_t index) const {
 }
 
 Province::index_t Map::get_index_from_colour(colour_t colour) const {
-	const colour_index_map_t::const_iterator it = colour_index_map.find(colour);
-	if (it != colour_index_map.end()) {
-		return it->second;
-	}
-	return Province::NULL_INDEX;
+	return colour_index_map.get_index(colour);
 }
 
 Province::index_t Map::get_province_index_at(size_t x, size_t y) const {
 	if (x < width && y < height) {
-		return province_shape_image[x + y * width].index;
+		return province_shape_image.get_pixel(x, y).index;
 	}
 	return Province::NULL_INDEX;
 }
 
+bool Map::get_province_indices_at(
+	std::span<const int32_t> xs, std::span<const int32_t> ys, std::span<Province::index_t> indices,
+	std::span<TerrainTypeMapping::index_t> terrains
+) const {
+	if (xs.size() != ys.size() || indices.size() < xs.size() || (!terrains.empty() && terrains.size() < xs.size())) {
+		Logger::error(
+			"Invalid province point query: ", xs.size(), " x coordinates, ", ys.size(), " y coordinates, ", indices.size(),
+			" index slots and ", terrains.size(), " terrain slots"
+		);
+		return false;
+	}
+	province_shape_image.get_pixels_at(xs, ys, indices.data(), !terrains.empty() ? terrains.data() : nullptr);
+	return true;
+}
+
 bool Map::set_max_provinces(Province::index_t new_max_provinces) {
 	if (new_max_provinces <= Province::NULL_INDEX) {
 		Logger::error(
@@ -187,6 +234,37 @@ Province::index_t Map::get_max_provinces() const {
 	return max_provinces;
 }
 
+void Map::mark_province_dirty(Province::index_t index) {
+	const size_t bit = index - 1;
+	if (index == Province::NULL_INDEX || bit / 64 >= dirty_provinces.size()) {
+		Logger::error("Trying to mark invalid province index ", index, " as dirty");
+		return;
+	}
+	dirty_provinces[bit / 64].fetch_or(uint64_t { 1 } << (bit % 64), std::memory_order_relaxed);
+}
+
+void Map::mark_all_provinces_dirty() {
+	const size_t province_count = provinces.size();
+	for (size_t word = 0; word < dirty_provinces.size(); ++word) {
+		const size_t bits_in_word = std::min<size_t>(64, province_count - word * 64);
+		dirty_provinces[word].store(
+			bits_in_word == 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << bits_in_word) - 1, std::memory_order_relaxed
+		);
+	}
+}
+
+void Map::_collect_dirty_provinces() {
+	dirty_province_list.clear();
+	for (size_t word = 0; word < dirty_provinces.size(); ++word) {
+		uint64_t bits = dirty_provinces[word].exchange(0, std::memory_order_relaxed);
+		while (bits != 0) {
+			const size_t bit = std::countr_zero(bits);
+			dirty_province_list.push_back(static_cast<Province::index_t>(word * 64 + bit + 1));
+			bits &= bits - 1;
+		}
+	}
+}
+
 void Map::set_selected_province(Province::index_t index) {
 	if (index > get_province_count()) {
 		Logger::error(
@@ -215,10 +293,36 @@ size_t Map::get_height() const {
 }
 
 std::vector<Map::shape_pixel_t> const& Map::get_province_shape_image() const {
+	return province_shape_image.get_pixels();
+}
+
+ProvinceShapeImage const& Map::get_province_shape() const {
 	return province_shape_image;
 }
 
-bool Map::add_mapmode(std::string_view identifier, Mapmode::colour_func_t colour_func) {
+std::vector<Province::adjacency_t> const& Map::get_adjacencies() const {
+	return adjacencies;
+}
+
+std::vector<uint32_t> const& Map::get_adjacency_offsets() const {
+	return adjacency_offsets;
+}
+
+size_t Map::_get_image_band_count() const {
+	/* A few bands per thread so uneven bands still balance out. */
+	return thread_pool.is_parallel() ? std::min(height, (thread_pool.get_thread_count() + 1) * 4) : std::min<size_t>(height, 1);
+}
+
+bool Map::add_mapmode(
+	std::string_view identifier, Mapmode::colour_func_t colour_func, bool uses_map_state, bool thread_safe
+) {
+	return _add_mapmode(identifier, std::move(colour_func), nullptr, uses_map_state, thread_safe);
+}
+
+bool Map::_add_mapmode(
+	std::string_view identifier, Mapmode::colour_func_t&& colour_func, Mapmode::batch_func_t&& batch_func,
+	bool uses_map_state, bool thread_safe
+) {
 	if (identifier.empty()) {
 		Logger::error("Invalid mapmode identifier - empty!");
 		return false;
@@ -227,14 +331,68 @@ bool Map::add_mapmode(std::string_view identifier, Mapmode::colour_func_t colour
 		Logger::error("Mapmode colour function is null for identifier: ", identifier);
 		return false;
 	}
-	return mapmodes.add_item({ identifier, mapmodes.size(), colour_func });
+	return mapmodes.add_item({
+		identifier, mapmodes.size(), std::move(colour_func), std::move(batch_func), uses_map_state, thread_safe
+	});
 }
 
 Mapmode const* Map::get_mapmode_by_index(size_t index) const {
 	return mapmodes.get_item_by_index(index);
 }
 
+/* Writes each base and stripe colour pair as RGBA bytes. Every 32-bit ARGB colour just has its red and blue bytes
+ * swapped, so whole 64-bit pairs are swizzled at once, or two pairs per SIMD shuffle. */
+static void write_base_stripes_rgba(Mapmode::base_stripe_t const* base_stripes, size_t count, uint8_t* target) {
+	size_t idx = 0;
+	if constexpr (std::endian::native == std::endian::little) {
+#if defined(__SSSE3__)
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for (; idx + 2 <= count; idx += 2) {
+			const __m128i pairs = _mm_loadu_si128(reinterpret_cast<__m128i const*>(base_stripes + idx));
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i*>(target + idx * sizeof(Mapmode::base_stripe_t)), _mm_shuffle_epi8(pairs, shuffle)
+			);
+		}
+#elif defined(OPENVIC_MAP_SSE2)
+		const __m128i green_alpha_mask = _mm_set1_epi32(0xFF00FF00), low_byte_mask = _mm_set1_epi32(0x000000FF);
+		for (; idx + 2 <= count; idx += 2) {
+			const __m128i pairs = _mm_loadu_si128(reinterpret_cast<__m128i const*>(base_stripes + idx));
+			const __m128i swizzled = _mm_or_si128(
+				_mm_and_si128(pairs, green_alpha_mask), _mm_or_si128(
+					_mm_and_si128(_mm_srli_epi32(pairs, 16), low_byte_mask),
+					_mm_slli_epi32(_mm_and_si128(pairs, low_byte_mask), 16)
+				)
+			);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(target + idx * sizeof(Mapmode::base_stripe_t)), swizzled);
+		}
+#endif
+		static constexpr Mapmode::base_stripe_t GREEN_ALPHA_MASK = 0xFF00FF00FF00FF00, LOW_BYTE_MASK = 0x000000FF000000FF;
+		for (; idx < count; ++idx) {
+			const Mapmode::base_stripe_t base_stripe = base_stripes[idx];
+			const Mapmode::base_stripe_t swizzled = (base_stripe & GREEN_ALPHA_MASK) |
+				((base_stripe >> 16) & LOW_BYTE_MASK) | ((base_stripe & LOW_BYTE_MASK) << 16);
+			std::memcpy(target + idx * sizeof(Mapmode::base_stripe_t), &swizzled, sizeof(swizzled));
+		}
+	} else {
+		for (; idx < count; ++idx) {
+			const colour_t base_colour = static_cast<colour_t>(base_stripes[idx]);
+			const colour_t stripe_colour = static_cast<colour_t>(base_stripes[idx] >> (sizeof(colour_t) * 8));
+
+			*target++ = (base_colour >> 16) & COLOUR_COMPONENT; // red
+			*target++ = (base_colour >>  8) & COLOUR_COMPONENT; // green
+			*target++ = (base_colour >>  0) & COLOUR_COMPONENT; // blue
+			*target++ = (base_colour >> 24) & COLOUR_COMPONENT; // alpha
+
+			*target++ = (stripe_colour >> 16) & COLOUR_COMPONENT; // red
+			*target++ = (stripe_colour >>  8) & COLOUR_COMPONENT; // green
+			*target++ = (stripe_colour >>  0) & COLOUR_COMPONENT; // blue
+			*target++ = (stripe_colour >> 24) & COLOUR_COMPONENT; // alpha
+		}
+	}
+}
+
 bool Map::generate_mapmode_colours(Mapmode::index_t index, uint8_t* target) const {
+	OV_PROFILE_SCOPE("Map::generate_mapmode_colours");
 	if (target == nullptr) {
 		Logger::error("Mapmode colour target pointer is null!");
 		return false;
@@ -255,51 +413,181 @@ bool Map::generate_mapmode_colours(Mapmode::index_t index, uint8_t* target) cons
 	for (size_t i = 0; i < sizeof(Mapmode::base_stripe_t); ++i) {
 		*target++ = 0;
 	}
-	for (Province const& province : provinces.get_items()) {
-		const Mapmode::base_stripe_t base_stripe = mapmode->get_base_stripe_colours(*this, province);
-		const colour_t base_colour = static_cast<colour_t>(base_stripe);
-		const colour_t stripe_colour = static_cast<colour_t>(base_stripe >> (sizeof(colour_t) * 8));
+	const std::lock_guard<std::mutex> lock { mapmode_cache_mutex };
+	std::vector<Mapmode::base_stripe_t> const* colours;
+	if (mapmode == &Mapmode::ERROR_MAPMODE) {
+		mapmode_colour_buffer.resize(provinces.size());
+		mapmode->get_base_stripe_colours(*this, provinces.get_items(), mapmode_colour_buffer.data());
+		colours = &mapmode_colour_buffer;
+	} else {
+		colours = &_update_mapmode_cache(*mapmode).colours;
+	}
+	/* Converting colours never calls into the mapmode, so it can always be split across the thread pool. */
+	thread_pool.parallel_for(colours->size(), MAPMODE_WRITE_CHUNK_SIZE, [colours, target](size_t begin, size_t end) {
+		write_base_stripes_rgba(colours->data() + begin, end - begin, target + begin * sizeof(Mapmode::base_stripe_t));
+	});
+	return ret;
+}
 
-		*target++ = (base_colour >> 16) & COLOUR_COMPONENT; // red
-		*target++ = (base_colour >>  8) & COLOUR_COMPONENT; // green
-		*target++ = (base_colour >>  0) & COLOUR_COMPONENT; // blue
-		*target++ = (base_colour >> 24) & COLOUR_COMPONENT; // alpha
+Map::mapmode_cache_t const& Map::_update_mapmode_cache(Mapmode const& mapmode) const {
+	if (mapmode_caches.size() < mapmodes.size()) {
+		mapmode_caches.resize(mapmodes.size());
+	}
+	mapmode_cache_t& cache = mapmode_caches[mapmode.get_index()];
+	if (cache.state_version == state_version && cache.colours.size() == provinces.size()) {
+		return cache;
+	}
+	OV_PROFILE_SCOPE("Map::_update_mapmode_cache");
 
-		*target++ = (stripe_colour >> 16) & COLOUR_COMPONENT; // red
-		*target++ = (stripe_colour >>  8) & COLOUR_COMPONENT; // green
-		*target++ = (stripe_colour >>  0) & COLOUR_COMPONENT; // blue
-		*target++ = (stripe_colour >> 24) & COLOUR_COMPONENT; // alpha
+	const bool first_fill = cache.state_version == 0 || cache.colours.size() != provinces.size();
+	if (first_fill) {
+		cache.colours.assign(provinces.size(), 0);
+		cache.colour_versions.assign(provinces.size(), 0);
 	}
-	return ret;
+	const bool update_all =
+		first_fill || (mapmode.get_uses_map_state() && map_aggregates_version > cache.state_version);
+
+	const std::span<const Province> province_list = provinces.get_items();
+	const auto needs_update = [this, &cache, update_all](size_t idx) -> bool {
+		return update_all || province_state_versions[idx] > cache.state_version;
+	};
+	/* Colour each run of consecutive provinces needing an update in one batch. */
+	for (size_t begin = 0; begin < province_list.size(); ++begin) {
+		if (!needs_update(begin)) {
+			continue;
+		}
+		size_t end = begin + 1;
+		while (end < province_list.size() && needs_update(end)) {
+			end++;
+		}
+		mapmode_colour_buffer.resize(end - begin);
+		if (mapmode.get_thread_safe()) {
+			thread_pool.parallel_for(end - begin, PROVINCE_CHUNK_SIZE, [this, &mapmode, province_list, begin](
+				size_t chunk_begin, size_t chunk_end
+			) {
+				mapmode.get_base_stripe_colours(
+					*this, province_list.subspan(begin + chunk_begin, chunk_end - chunk_begin),
+					mapmode_colour_buffer.data() + chunk_begin
+				);
+			});
+		} else {
+			mapmode.get_base_stripe_colours(*this, province_list.subspan(begin, end - begin), mapmode_colour_buffer.data());
+		}
+		for (size_t idx = begin; idx < end; ++idx) {
+			const Mapmode::base_stripe_t base_stripe = mapmode_colour_buffer[idx - begin];
+			/* Only stamp colours which actually changed, so updates which leave a province looking the same don't make
+			 * renderers re-upload it. */
+			if (first_fill || base_stripe != cache.colours[idx]) {
+				cache.colours[idx] = base_stripe;
+				cache.colour_versions[idx] = state_version;
+			}
+		}
+		begin = end;
+	}
+	cache.state_version = state_version;
+	return cache;
 }
 
-void Map::update_highest_province_population() {
-	highest_province_population = 0;
-	for (Province const& province : provinces.get_items()) {
-		highest_province_population = std::max(highest_province_population, province.get_total_population());
+bool Map::get_mapmode_colour_changes(
+	Mapmode::index_t index, uint64_t since_version, std::vector<mapmode_colour_change_t>& changes,
+	uint64_t& current_version
+) const {
+	OV_PROFILE_SCOPE("Map::get_mapmode_colour_changes");
+	current_version = state_version;
+	Mapmode const* mapmode = mapmodes.get_item_by_index(index);
+	if (mapmode == nullptr) {
+		Logger::error("Invalid mapmode index: ", index);
+		return false;
+	}
+	const std::lock_guard<std::mutex> lock { mapmode_cache_mutex };
+	mapmode_cache_t const& cache = _update_mapmode_cache(*mapmode);
+	for (size_t idx = 0; idx < cache.colours.size(); ++idx) {
+		if (cache.colour_versions[idx] > since_version) {
+			changes.push_back({ static_cast<Province::index_t>(idx + 1), cache.colours[idx] });
+		}
 	}
+	return true;
 }
 
-Pop::pop_size_t Map::get_highest_province_population() const {
-	return highest_province_population;
+uint64_t Map::get_state_version() const {
+	return state_version;
 }
 
-void Map::update_total_map_population() {
+bool Map::_count_province_population(Province const& province) {
+	const size_t idx = province.get_index() - 1;
+	const Pop::pop_size_t old_population = province_populations.get(idx);
+	const Pop::pop_size_t new_population = province_state.get_total_population(province.get_index());
+	Country const* old_owner = counted_owners[idx];
+	Country const* new_owner = province_state.get_owner(province.get_index());
+	if (old_population == new_population && old_owner == new_owner) {
+		return false;
+	}
+
+	if (province.get_has_region()) {
+		region_populations[province.get_region() - regions.get_items().data()] += new_population - old_population;
+	}
+	if (old_owner != nullptr) {
+		const decltype(owner_populations)::iterator it = owner_populations.find(old_owner);
+		if (it != owner_populations.end() && (it->second -= old_population) == 0) {
+			owner_populations.erase(it);
+		}
+	}
+	if (new_owner != nullptr) {
+		owner_populations[new_owner] += new_population;
+	}
+	counted_owners[idx] = new_owner;
+
+	if (old_population != new_population) {
+		province_populations.set(idx, new_population);
+		total_map_population += new_population - old_population;
+	}
+	return true;
+}
+
+void Map::_recount_population_aggregates() {
+	province_populations.reset(provinces.size());
+	counted_owners.assign(provinces.size(), nullptr);
 	total_map_population = 0;
+	region_populations.assign(regions.size(), 0);
+	owner_populations.clear();
 	for (Province const& province : provinces.get_items()) {
-		total_map_population += province.get_total_population();
+		_count_province_population(province);
 	}
+	map_aggregates_version = state_version;
+}
+
+Pop::pop_size_t Map::get_highest_province_population() const {
+	return province_populations.get_max();
+}
+
+Province const* Map::get_most_populous_province() const {
+	return province_populations.get_size() > 0 ? provinces.get_item_by_index(province_populations.get_max_index())
+		: nullptr;
 }
 
 Pop::pop_size_t Map::get_total_map_population() const {
 	return total_map_population;
 }
 
+Pop::pop_size_t Map::get_region_population(Region const& region) const {
+	const size_t idx = &region - regions.get_items().data();
+	return idx < region_populations.size() ? region_populations[idx] : 0;
+}
+
+Pop::pop_size_t Map::get_owner_population(Country const* owner) const {
+	const decltype(owner_populations)::const_iterator it = owner_populations.find(owner);
+	return it != owner_populations.end() ? it->second : 0;
+}
+
 bool Map::reset(BuildingManager const& building_manager) {
 	bool ret = true;
 	for (Province& province : provinces.get_items()) {
 		ret &= province.reset(building_manager);
 	}
+	/* Resetting clears every province's population without going through update_state, so the
+	 * incrementally maintained aggregates have to be rebuilt from scratch. */
+	_recount_population_aggregates();
+	mark_all_provinces_dirty();
 	return ret;
 }
 
@@ -318,20 +606,107 @@ bool Map::apply_history_to_provinces(ProvinceHistoryManager const& history_manag
 	return ret;
 }
 
-void Map::update_state(Date today) {
-	for (Province& province : provinces.get_items()) {
-		province.update_state(today);
+void Map::save_snapshot(
+	BinaryWriter& writer, CountryManager const& country_manager, GoodManager const& good_manager,
+	PopManager const& pop_manager
+) const {
+	writer.write<uint32_t>(provinces.size());
+	for (Province const& province : provinces.get_items()) {
+		province.save_snapshot(writer, country_manager, good_manager, pop_manager);
 	}
-	update_highest_province_population();
-	update_total_map_population();
 }
 
-void Map::tick(Date today) {
+bool Map::load_snapshot(
+	BinaryReader& reader, CountryManager const& country_manager, GoodManager const& good_manager,
+	PopManager const& pop_manager
+) {
+	uint32_t province_count;
+	if (!reader.read(province_count)) {
+		return false;
+	}
+	if (province_count != provinces.size()) {
+		Logger::error("Snapshot has ", province_count, " provinces, expected ", provinces.size());
+		return false;
+	}
 	for (Province& province : provinces.get_items()) {
-		province.tick(today);
+		if (!province.load_snapshot(reader, country_manager, good_manager, pop_manager)) {
+			Logger::error("Failed to load snapshot of province ", province);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Each province's update only touches that province's own buildings and pops, so provinces can be processed
+ * concurrently without any change to the results. Only provinces flagged as dirty since the last update are
+ * recalculated, with the map-wide population aggregates adjusted by their change in population. */
+void Map::update_state(Date today) {
+	OV_PROFILE_SCOPE("Map::update_state");
+	_collect_dirty_provinces();
+	OV_PROFILE_COUNTER("Dirty provinces updated", dirty_province_list.size());
+	if (dirty_province_list.empty()) {
+		return;
+	}
+
+	state_version++;
+	for (const Province::index_t index : dirty_province_list) {
+		province_state_versions[index - 1] = state_version;
+	}
+
+	thread_pool.parallel_for(dirty_province_list.size(), PROVINCE_CHUNK_SIZE, [this, today](size_t begin, size_t end) {
+		for (size_t idx = begin; idx < end; ++idx) {
+			get_province_by_index(dirty_province_list[idx])->update_state(today);
+		}
+	});
+
+	/* Each recalculated province reports its change in population to the aggregates, costing O(log n) for the
+	 * highest population rather than a pass over every province. */
+	for (const Province::index_t index : dirty_province_list) {
+		if (_count_province_population(*get_province_by_index(index))) {
+			map_aggregates_version = state_version;
+		}
 	}
 }
 
+/* Provinces' rates are worked out in one pass over the ProvinceState columns, then the pops are updated by province
+ * range across the thread pool. Each range only touches its own provinces' rows of the PopStore. */
+void Map::update_demographics(demographic_defines_t const& defines) {
+	OV_PROFILE_SCOPE("Map::update_demographics");
+	const size_t province_count = provinces.size();
+	demographic_rates.resize(province_count + 1);
+	for (size_t index = 1; index <= province_count; ++index) {
+		/* Until needs satisfaction and promotion chance modifiers are simulated, every pop is equally likely to promote
+		 * or migrate, with the chances set by the scales alone. Pops don't demote until there is a demotion rate. */
+		demographic_rates[index] = {
+			defines.base_growth + province_state.get_population_growth_modifier(index) + defines.life_rating_growth_bonus *
+				(province_state.get_life_rating(index) - defines.min_life_rating_for_growth),
+			defines.promotion_scale, 0, defines.migration_scale
+		};
+	}
+
+	thread_pool.parallel_for(province_count, DEMOGRAPHICS_PROVINCE_CHUNK_SIZE, [this](size_t begin, size_t end) {
+		pop_store.update_demographics(begin + 1, end + 1, demographic_rates);
+	});
+
+	for (size_t index = 1; index <= province_count; ++index) {
+		if (pop_store.get_province_range(index).count > 0) {
+			mark_province_dirty(index);
+		}
+	}
+}
+
+/* Splitting a pop may grow its province's block, resizing the columns shared by every province, so unlike
+ * update_demographics this runs on a single thread. */
+void Map::consolidate_pops() {
+	OV_PROFILE_SCOPE("Map::consolidate_pops");
+	for (size_t index = 1; index <= provinces.size(); ++index) {
+		if (pop_store.consolidate_province(index)) {
+			mark_province_dirty(index);
+		}
+	}
+	OV_PROFILE_COUNTER("Pops after consolidation", pop_store.get_pop_count());
+}
+
 using namespace ovdl::csv;
 
 static bool validate_province_definitions_header(LineObject const& header) {
@@ -385,6 +760,7 @@ bool Map::load_province_definitions(std::vector<LineObject> const& lines) {
 		return false;
 	}
 	provinces.reserve(lines.size() - 1);
+	colour_index_map.reserve(lines.size() - 1);
 	bool ret = true;
 	std::for_each(lines.begin() + 1, lines.end(), [this, &ret](LineObject const& line) -> void {
 		const std::string_view identifier = line.get_value_for(0);
@@ -398,6 +774,11 @@ bool Map::load_province_definitions(std::vector<LineObject> const& lines) {
 		}
 	});
 	lock_provinces();
+	dirty_provinces = std::vector<std::atomic<uint64_t>>((provinces.size() + 63) / 64);
+	province_state_versions.assign(provinces.size(), 0);
+	pop_store.reset(provinces.size());
+	_recount_population_aggregates();
+	mark_all_provinces_dirty();
 	return ret;
 }
 
@@ -444,19 +825,57 @@ bool Map::load_region_file(ast::NodeCPtr root) {
 			province.has_region = !region_null;
 		}
 	}
+	/* Regions are only known now, so their totals start from scratch. */
+	_recount_population_aggregates();
 	return ret;
 }
 
-static constexpr colour_t colour_at(uint8_t const* colour_data, int32_t idx) {
-	/* colour_data is filled with BGR byte triplets - to get pixel idx as a
-	 * single RGB value, multiply idx by 3 to get the index of the corresponding
-	 * triplet, then combine the bytes in reverse order.
-	 */
-	idx *= 3;
-	return (colour_data[idx + 2] << 16) | (colour_data[idx + 1] << 8) | colour_data[idx];
+/* Converts count pixels of BGR byte triplets into packed RGB colours. */
+static void decode_bgr_row(uint8_t const* bgr, colour_t* colours, size_t count) {
+	size_t x = 0;
+#if defined(__SSSE3__)
+	/* Each 16 byte load covers five and a third pixels, the first four of which are spread into 32-bit lanes with
+	 * their top bytes zeroed. Stopping two pixels early keeps the loads inside the row. */
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	for (; x + 6 <= count; x += 4) {
+		const __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(bgr + x * 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(colours + x), _mm_shuffle_epi8(pixels, shuffle));
+	}
+#endif
+	if constexpr (std::endian::native == std::endian::little) {
+		/* A little-endian 4 byte load of a BGR triplet is the RGB colour plus the next pixel's blue in the top byte. */
+		for (; x + 2 <= count; ++x) {
+			uint32_t pixel;
+			std::memcpy(&pixel, bgr + x * 3, sizeof(pixel));
+			colours[x] = pixel & MAX_COLOUR_RGB;
+		}
+	}
+	for (; x < count; ++x) {
+		colours[x] = (bgr[x * 3 + 2] << 16) | (bgr[x * 3 + 1] << 8) | bgr[x * 3];
+	}
+}
+
+/* Returns the index of the first pixel from begin onwards whose colour is not colour, or count if there is none. */
+static size_t find_colour_run_end(colour_t const* colours, size_t begin, size_t count, colour_t colour) {
+	size_t x = begin;
+#if defined(OPENVIC_MAP_SSE2)
+	const __m128i target = _mm_set1_epi32(colour);
+	for (; x + 4 <= count; x += 4) {
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(colours + x));
+		const uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi32(block, target));
+		if (mask != 0xFFFF) {
+			return x + std::countr_one(mask) / sizeof(colour_t);
+		}
+	}
+#endif
+	while (x < count && colours[x] == colour) {
+		++x;
+	}
+	return x;
 }
 
 bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain_path, bool detailed_errors) {
+	OV_PROFILE_SCOPE("Map::load_map_images");
 	if (!provinces.is_locked()) {
 		Logger::error("Province index image cannot be generated until after provinces are locked!");
 		return false;
@@ -466,8 +885,9 @@ bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain
 		return false;
 	}
 
+	/* Both images are memory-mapped and decoded straight from the mapping, without copying their pixel data. */
 	BMP province_bmp;
-	if (!(province_bmp.open(province_path) && province_bmp.read_header() && province_bmp.read_pixel_data())) {
+	if (!(province_bmp.open(province_path, true) && province_bmp.read_header() && province_bmp.read_pixel_data())) {
 		Logger::error("Failed to read BMP for compatibility mode province image: ", province_path);
 		return false;
 	}
@@ -481,7 +901,7 @@ bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain
 	}
 
 	BMP terrain_bmp;
-	if (!(terrain_bmp.open(terrain_path) && terrain_bmp.read_header() && terrain_bmp.read_pixel_data())) {
+	if (!(terrain_bmp.open(terrain_path, true) && terrain_bmp.read_header() && terrain_bmp.read_pixel_data())) {
 		Logger::error("Failed to read BMP for compatibility mode terrain image: ", terrain_path);
 		return false;
 	}
@@ -503,65 +923,180 @@ bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain
 
 	width = province_bmp.get_width();
 	height = province_bmp.get_height();
-	province_shape_image.resize(width * height);
-
-	uint8_t const* province_data = province_bmp.get_pixel_data().data();
-	uint8_t const* terrain_data = terrain_bmp.get_pixel_data().data();
-
-	std::vector<bool> province_checklist(provinces.size());
-	std::vector<fixed_point_map_t<TerrainType const*>> terrain_type_pixels_list(provinces.size());
-	bool ret = true;
-	std::unordered_set<colour_t> unrecognised_province_colours;
+	province_shape_image.reset(width, height, province_shape_storage);
+	const bool raw_shape_image = province_shape_storage == ProvinceShapeImage::storage_t::RAW;
+
+	/* Resolve every possible terrain byte up front, rather than looking up its mapping for each pixel. */
+	std::vector<TerrainType> const& terrain_types = terrain_type_manager.get_terrain_types();
+	const size_t terrain_type_count = terrain_types.size();
+	struct terrain_lookup_t {
+		TerrainTypeMapping::index_t shape_terrain;
+		/* terrain_type_count if the terrain byte has no mapping. */
+		size_t type_index;
+	};
+	std::array<terrain_lookup_t, 1 << (sizeof(TerrainTypeMapping::index_t) * 8)> terrain_lookup;
+	for (size_t terrain = 0; terrain < terrain_lookup.size(); ++terrain) {
+		TerrainTypeMapping const* mapping = terrain_type_manager.get_terrain_type_mapping_for(terrain);
+		if (mapping != nullptr) {
+			terrain_lookup[terrain] = {
+				static_cast<TerrainTypeMapping::index_t>(
+					mapping->get_has_texture() && terrain < terrain_type_manager.get_terrain_texture_limit() ? terrain + 1 : 0
+				),
+				static_cast<size_t>(&mapping->get_type() - terrain_types.data())
+			};
+		} else {
+			terrain_lookup[terrain] = { 0, terrain_type_count };
+		}
+	}
 
-	for (size_t y = 0; y < height; ++y) {
-		for (size_t x = 0; x < width; ++x) {
-			const size_t idx = x + y * width;
-
-			const colour_t province_colour = colour_at(province_data, idx);
-			if (x > 0) {
-				const size_t jdx = idx - 1;
-				if (colour_at(province_data, jdx) == province_colour) {
-					province_shape_image[idx].index = province_shape_image[jdx].index;
-					goto set_terrain;
-				}
-			}
-			if (y > 0) {
-				const size_t jdx = idx - width;
-				if (colour_at(province_data, jdx) == province_colour) {
-					province_shape_image[idx].index = province_shape_image[jdx].index;
-					goto set_terrain;
+	/* The image is decoded in bands of rows, each with its own pixel counts, province extents and unrecognised colour
+	 * list so bands can run on separate threads. Counts and extents are only kept for the provinces appearing in each
+	 * band, so their memory doesn't grow with the number of bands. A band never reuses province indices from the row above its first row,
+	 * as that row may still be being decoded by another band. Bands are merged in order, so the results and warnings are
+	 * the same as for a single band. */
+	struct unrecognised_colour_t {
+		colour_t colour;
+		size_t x, y;
+	};
+	/* The sums of a province's pixel coordinates, from which its centroid is found, and its bounding box. */
+	struct province_extent_t {
+		uint64_t sum_x = 0, sum_y = 0;
+		uint32_t min_x = std::numeric_limits<uint32_t>::max(), min_y = std::numeric_limits<uint32_t>::max();
+		uint32_t max_x = 0, max_y = 0;
+
+		void add(province_extent_t const& other) {
+			sum_x += other.sum_x;
+			sum_y += other.sum_y;
+			min_x = std::min(min_x, other.min_x);
+			min_y = std::min(min_y, other.min_y);
+			max_x = std::max(max_x, other.max_x);
+			max_y = std::max(max_y, other.max_y);
+		}
+	};
+	struct band_t {
+		/* The provinces appearing in the band, in order of first appearance. */
+		std::vector<Province::index_t> province_indices;
+		/* For each of province_indices, its pixel count for every terrain type followed by its total pixel count. */
+		std::vector<uint32_t> pixel_counts;
+		std::vector<province_extent_t> extents;
+		/* With RUNS storage, each row's runs are encoded here, ending at the corresponding entry of row_run_ends. */
+		std::vector<ProvinceShapeImage::run_t> runs;
+		std::vector<uint32_t> row_run_ends;
+		/* The first appearance of each unrecognised colour within the band, in scan order. */
+		std::vector<unrecognised_colour_t> unrecognised_colours;
+	};
+	const size_t counts_stride = terrain_type_count + 1;
+	const size_t band_count = _get_image_band_count();
+	const size_t band_height = band_count > 0 ? (height + band_count - 1) / band_count : 0;
+	std::vector<band_t> bands(band_count);
+
+	thread_pool.parallel_for(band_count, 1, [&](size_t band_begin, size_t band_end) -> void {
+		std::vector<colour_t> row_colours(width), previous_row_colours(width);
+		/* One more than the position of each province in the current band's province_indices, or 0 if it hasn't
+		 * appeared in the band yet. */
+		std::vector<uint32_t> band_slots(provinces.size() + 1, 0);
+		/* Rows are decoded straight into RAW images, otherwise into these before being encoded as runs. */
+		std::vector<shape_pixel_t> row_pixels, previous_row_pixels;
+		if (!raw_shape_image) {
+			row_pixels.resize(width);
+			previous_row_pixels.resize(width);
+		}
+		for (size_t band_index = band_begin; band_index < band_end; ++band_index) {
+			band_t& band = bands[band_index];
+			std::unordered_set<colour_t> band_unrecognised_colours;
+
+			const size_t first_row = band_index * band_height;
+			const size_t last_row = std::min(first_row + band_height, height);
+			for (size_t y = first_row; y < last_row; ++y) {
+				decode_bgr_row(province_bmp.get_pixel_row(y), row_colours.data(), width);
+				shape_pixel_t* shape_row = raw_shape_image ? province_shape_image.get_raw_row(y) : row_pixels.data();
+				shape_pixel_t const* previous_shape_row = !raw_shape_image ? previous_row_pixels.data()
+					: y > first_row ? shape_row - width : nullptr;
+				uint8_t const* terrain_row = terrain_bmp.get_pixel_row(y);
+
+				for (size_t x = 0; x < width;) {
+					const colour_t province_colour = row_colours[x];
+					const size_t run_end = find_colour_run_end(row_colours.data(), x + 1, width, province_colour);
+
+					Province::index_t index;
+					if (y > first_row && previous_row_colours[x] == province_colour) {
+						index = previous_shape_row[x].index;
+					} else {
+						index = get_index_from_colour(province_colour);
+						if (index == Province::NULL_INDEX && band_unrecognised_colours.insert(province_colour).second) {
+							band.unrecognised_colours.push_back({ province_colour, x, y });
+						}
+					}
+
+					uint32_t* province_counts = nullptr;
+					if (index != Province::NULL_INDEX) {
+						uint32_t& slot = band_slots[index];
+						if (slot == 0) {
+							band.province_indices.push_back(index);
+							band.pixel_counts.resize(band.pixel_counts.size() + counts_stride, 0);
+							band.extents.emplace_back();
+							slot = band.province_indices.size();
+						}
+						province_counts = band.pixel_counts.data() + (slot - 1) * counts_stride;
+						const size_t run_length = run_end - x;
+						province_counts[terrain_type_count] += run_length;
+						province_extent_t& extent = band.extents[slot - 1];
+						/* The x coordinates of the run's pixels are an arithmetic series. */
+						extent.sum_x += (x + run_end - 1) * run_length / 2;
+						extent.sum_y += y * run_length;
+						extent.min_x = std::min<uint32_t>(extent.min_x, x);
+						extent.min_y = std::min<uint32_t>(extent.min_y, y);
+						extent.max_x = std::max<uint32_t>(extent.max_x, run_end - 1);
+						extent.max_y = y;
+					}
+					for (; x < run_end; ++x) {
+						terrain_lookup_t const& terrain = terrain_lookup[terrain_row[x]];
+						shape_row[x] = { index, terrain.shape_terrain };
+						if (province_counts != nullptr && terrain.type_index < terrain_type_count) {
+							province_counts[terrain.type_index]++;
+						}
+					}
 				}
-			}
-			{
-				const Province::index_t index = get_index_from_colour(province_colour);
-				if (index != Province::NULL_INDEX) {
-					province_checklist[index - 1] = true;
-					province_shape_image[idx].index = index;
-					goto set_terrain;
+				row_colours.swap(previous_row_colours);
+				if (!raw_shape_image) {
+					ProvinceShapeImage::encode_row(row_pixels, band.runs);
+					band.row_run_ends.push_back(band.runs.size());
+					row_pixels.swap(previous_row_pixels);
 				}
 			}
-			if (!unrecognised_province_colours.contains(province_colour)) {
-				unrecognised_province_colours.insert(province_colour);
-				if (detailed_errors) {
-					Logger::warning(
-						"Unrecognised province colour ", colour_to_hex_string(province_colour), " at (", x, ", ", y, ")"
-					);
-				}
+			for (const Province::index_t index : band.province_indices) {
+				band_slots[index] = 0;
 			}
-			province_shape_image[idx].index = Province::NULL_INDEX;
-
-		set_terrain:
-			const TerrainTypeMapping::index_t terrain = terrain_data[idx];
-			TerrainTypeMapping const* mapping = terrain_type_manager.get_terrain_type_mapping_for(terrain);
-			if (mapping != nullptr) {
-				if (province_shape_image[idx].index != Province::NULL_INDEX) {
-					terrain_type_pixels_list[province_shape_image[idx].index - 1][&mapping->get_type()]++;
-				}
+		}
+	});
 
-				province_shape_image[idx].terrain =
-					mapping->get_has_texture() && terrain < terrain_type_manager.get_terrain_texture_limit() ? terrain + 1 : 0;
-			} else {
-				province_shape_image[idx].terrain = 0;
+	std::vector<uint32_t> pixel_counts(provinces.size() * counts_stride, 0);
+	std::vector<province_extent_t> extents(provinces.size());
+	std::unordered_set<colour_t> unrecognised_province_colours;
+	for (band_t& band : bands) {
+		for (size_t slot = 0; slot < band.province_indices.size(); ++slot) {
+			const size_t idx = band.province_indices[slot] - 1;
+			uint32_t const* band_counts = band.pixel_counts.data() + slot * counts_stride;
+			uint32_t* province_counts = pixel_counts.data() + idx * counts_stride;
+			for (size_t terrain = 0; terrain < counts_stride; ++terrain) {
+				province_counts[terrain] += band_counts[terrain];
+			}
+			extents[idx].add(band.extents[slot]);
+		}
+		band.pixel_counts = {};
+		band.extents = {};
+		size_t row_begin = 0;
+		for (const uint32_t row_end : band.row_run_ends) {
+			province_shape_image.append_row_runs({ band.runs.data() + row_begin, band.runs.data() + row_end });
+			row_begin = row_end;
+		}
+		band.runs = {};
+		for (unrecognised_colour_t const& unrecognised : band.unrecognised_colours) {
+			if (unrecognised_province_colours.insert(unrecognised.colour).second && detailed_errors) {
+				Logger::warning(
+					"Unrecognised province colour ", colour_to_hex_string(unrecognised.colour), " at (", unrecognised.x,
+					", ", unrecognised.y, ")"
+				);
 			}
 		}
 	}
@@ -571,12 +1106,30 @@ bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain
 	}
 
 	size_t missing = 0;
-	for (size_t idx = 0; idx < province_checklist.size(); ++idx) {
+	for (size_t idx = 0; idx < provinces.size(); ++idx) {
 		Province* province = provinces.get_item_by_index(idx);
-		const fixed_point_map_const_iterator_t<TerrainType const*> largest = get_largest_item(terrain_type_pixels_list[idx]);
-		province->default_terrain_type = largest != terrain_type_pixels_list[idx].end() ? largest->first : nullptr;
-		province->on_map = province_checklist[idx];
-		if (!province->on_map) {
+		uint32_t const* province_counts = pixel_counts.data() + idx * counts_stride;
+		/* The first terrain type with the most pixels, as with get_largest_item. */
+		const size_t largest = std::max_element(province_counts, province_counts + terrain_type_count) - province_counts;
+		province->default_terrain_type =
+			largest < terrain_type_count && province_counts[largest] > 0 ? &terrain_types[largest] : nullptr;
+		const uint32_t pixel_area = province_counts[terrain_type_count];
+		province->on_map = pixel_area > 0;
+		if (province->on_map) {
+			province_extent_t const& extent = extents[idx];
+			Province::shape_geometry_t& geometry = province->shape_geometry;
+			geometry.pixel_area = pixel_area;
+			geometry.bounds_min.x = extent.min_x;
+			geometry.bounds_min.y = extent.min_y;
+			geometry.bounds_max.x = extent.max_x;
+			geometry.bounds_max.y = extent.max_y;
+			/* Offset by half a pixel to the centres of the pixels. */
+			geometry.centroid.x =
+				fixed_point_t::parse_raw((extent.sum_x << fixed_point_t::PRECISION) / pixel_area) + fixed_point_t::_0_50();
+			geometry.centroid.y =
+				fixed_point_t::parse_raw((extent.sum_y << fixed_point_t::PRECISION) / pixel_area) + fixed_point_t::_0_50();
+		} else {
+			province->shape_geometry = {};
 			if (detailed_errors) {
 				Logger::warning("Province missing from shape image: ", province->to_string());
 			}
@@ -587,49 +1140,573 @@ bool Map::load_map_images(fs::path const& province_path, fs::path const& terrain
 		Logger::warning("Province image is missing ", missing, " province colours");
 	}
 
-	return ret;
+	/* Borders are traced here rather than when generating adjacencies, which take their province pairs from them. */
+	_find_shape_image_borders();
+
+	return true;
 }
 
 /* REQUIREMENTS:
  * MAP-19, MAP-84
  */
-bool Map::_generate_province_adjacencies() {
-	bool changed = false;
-
-	auto generate_adjacency = [&](Province* cur, size_t x, size_t y) -> bool {
-		Province* neighbour = get_province_by_index(province_shape_image[x + y * width].index);
-		if (neighbour != nullptr && cur != neighbour) {
-			return cur->add_adjacency(neighbour, 0, 0) | neighbour->add_adjacency(cur, 0, 0);
+void Map::_find_shape_image_borders() {
+	struct keyed_segment_t {
+		uint32_t key;
+		border_segment_t segment;
+	};
+	/* Orders segments by pair, then as described for border_segments, so contiguous segments end up adjacent. */
+	static constexpr auto segment_less = [](keyed_segment_t const& a, keyed_segment_t const& b) -> bool {
+		if (a.key != b.key) {
+			return a.key < b.key;
 		}
-		return false;
+		if (a.segment.vertical != b.segment.vertical) {
+			return b.segment.vertical;
+		}
+		if (a.segment.vertical) {
+			return a.segment.x != b.segment.x ? a.segment.x < b.segment.x : a.segment.y < b.segment.y;
+		}
+		return a.segment.y != b.segment.y ? a.segment.y < b.segment.y : a.segment.x < b.segment.x;
 	};
 
-	for (size_t y = 0; y < height; ++y) {
-		for (size_t x = 0; x < width; ++x) {
-			Province* cur = get_province_by_index(province_shape_image[x + y * width].index);
-			if (cur != nullptr) {
-				changed |= generate_adjacency(cur, (x + 1) % width, y);
-				if (y + 1 < height) {
-					changed |= generate_adjacency(cur, x, y + 1);
+	const size_t band_count = _get_image_band_count();
+	const size_t band_height = band_count > 0 ? (height + band_count - 1) / band_count : 0;
+	std::vector<std::vector<keyed_segment_t>> band_segments(band_count);
+
+	thread_pool.parallel_for(band_count, 1, [&](size_t band_begin, size_t band_end) -> void {
+		/* Rows are expanded one at a time, so this works the same whatever the image's storage. */
+		std::vector<shape_pixel_t> row(width), next_row(width);
+		/* The key and first row of the vertical segment being traced down the left edge of each column, if any. */
+		struct open_segment_t {
+			uint32_t key;
+			uint32_t start;
+		};
+		std::vector<open_segment_t> open_columns(width);
+		for (size_t band_index = band_begin; band_index < band_end; ++band_index) {
+			std::vector<keyed_segment_t>& segments = band_segments[band_index];
+			std::fill(open_columns.begin(), open_columns.end(), open_segment_t { 0, 0 });
+
+			const size_t first_row = band_index * band_height;
+			const size_t last_row = std::min(first_row + band_height, height);
+			if (first_row < last_row) {
+				province_shape_image.get_row(first_row, next_row.data());
+			}
+			for (size_t y = first_row; y < last_row; ++y) {
+				row.swap(next_row);
+				const bool has_next_row = y + 1 < height;
+				if (has_next_row) {
+					province_shape_image.get_row(y + 1, next_row.data());
+				}
+				/* The horizontal segment being traced along the bottom edge of the row, if any. */
+				uint32_t row_key = 0;
+				size_t row_start = 0;
+				for (size_t x = 0; x < width; ++x) {
+					const Province::index_t cur = row[x].index;
+
+					/* The map wraps around horizontally. */
+					const size_t right_x = x + 1 < width ? x + 1 : 0;
+					const uint32_t right_key = _make_border_key(cur, row[right_x].index);
+					open_segment_t& column = open_columns[right_x];
+					if (column.key != right_key) {
+						if (column.key != 0) {
+							segments.push_back({
+								column.key, {
+									static_cast<uint32_t>(right_x), column.start, static_cast<uint32_t>(y - column.start), true
+								}
+							});
+						}
+						column = { right_key, static_cast<uint32_t>(y) };
+					}
+
+					const uint32_t below_key = has_next_row ? _make_border_key(cur, next_row[x].index) : 0;
+					if (row_key != below_key) {
+						if (row_key != 0) {
+							segments.push_back({
+								row_key, {
+									static_cast<uint32_t>(row_start), static_cast<uint32_t>(y + 1),
+									static_cast<uint32_t>(x - row_start), false
+								}
+							});
+						}
+						row_key = below_key;
+						row_start = x;
+					}
+				}
+				if (row_key != 0) {
+					segments.push_back({
+						row_key, {
+							static_cast<uint32_t>(row_start), static_cast<uint32_t>(y + 1),
+							static_cast<uint32_t>(width - row_start), false
+						}
+					});
 				}
 			}
+			for (size_t x = 0; x < width; ++x) {
+				if (open_columns[x].key != 0) {
+					segments.push_back({
+						open_columns[x].key, {
+							static_cast<uint32_t>(x), open_columns[x].start,
+							static_cast<uint32_t>(last_row - open_columns[x].start), true
+						}
+					});
+				}
+			}
+			std::sort(segments.begin(), segments.end(), segment_less);
 		}
+	});
+
+	/* Merging the sorted bands in order and joining vertical segments cut at band edges gives the same result as a
+	 * single band. */
+	std::vector<keyed_segment_t> segments;
+	size_t segment_count = 0;
+	for (std::vector<keyed_segment_t> const& band : band_segments) {
+		segment_count += band.size();
+	}
+	segments.reserve(segment_count);
+	for (std::vector<keyed_segment_t>& band : band_segments) {
+		const size_t merged_count = segments.size();
+		segments.insert(segments.end(), band.begin(), band.end());
+		band = {};
+		std::inplace_merge(segments.begin(), segments.begin() + merged_count, segments.end(), segment_less);
 	}
 
-	return changed;
+	border_keys.clear();
+	border_offsets.clear();
+	border_segments.clear();
+	for (keyed_segment_t const& entry : segments) {
+		if (border_keys.empty() || border_keys.back() != entry.key) {
+			if (!border_keys.empty()) {
+				border_offsets.push_back(border_segments.size());
+			}
+			border_keys.push_back(entry.key);
+		} else {
+			border_segment_t& last = border_segments.back();
+			if (last.vertical == entry.segment.vertical && (
+				last.vertical ? last.x == entry.segment.x && last.y + last.length == entry.segment.y
+					: last.y == entry.segment.y && last.x + last.length == entry.segment.x
+			)) {
+				last.length += entry.segment.length;
+				continue;
+			}
+		}
+		border_segments.push_back(entry.segment);
+	}
+	if (!border_keys.empty()) {
+		border_offsets.push_back(border_segments.size());
+	}
+	border_segments.shrink_to_fit();
+}
+
+std::span<const Map::border_segment_t> Map::get_border_segments(Province const& a, Province const& b) const {
+	const uint32_t key = _make_border_key(a.get_index(), b.get_index());
+	const std::vector<uint32_t>::const_iterator it = std::lower_bound(border_keys.begin(), border_keys.end(), key);
+	if (key == 0 || it == border_keys.end() || *it != key) {
+		return {};
+	}
+	const size_t pair = it - border_keys.begin();
+	const size_t begin = pair > 0 ? border_offsets[pair - 1] : 0;
+	return { border_segments.data() + begin, border_segments.data() + border_offsets[pair] };
+}
+
+std::vector<Map::border_segment_t> const& Map::get_all_border_segments() const {
+	return border_segments;
+}
+
+bool Map::_apply_special_adjacencies(
+	std::vector<adjacency_edge_t>& edges, std::vector<ovdl::csv::LineObject> const& additional_adjacencies
+) const {
+	if (additional_adjacencies.empty()) {
+		return true;
+	}
+	bool ret = true;
+	std::vector<adjacency_edge_t> special_edges;
+	/* Skip the header line. */
+	std::for_each(
+		additional_adjacencies.begin() + 1, additional_adjacencies.end(),
+		[this, &ret, &special_edges](ovdl::csv::LineObject const& line) -> void {
+			const std::string_view from_identifier = line.get_value_for(0);
+			if (from_identifier.empty()) {
+				return;
+			}
+			const std::string_view to_identifier = line.get_value_for(1);
+			Province const* from = get_province_by_identifier(from_identifier);
+			Province const* to = get_province_by_identifier(to_identifier);
+			if (from == nullptr || to == nullptr || from == to) {
+				Logger::warning("Skipping invalid adjacency from \"", from_identifier, "\" to \"", to_identifier, "\"");
+				return;
+			}
+			Province::adjacency_t::type_t type;
+			if (!Province::adjacency_t::get_type_from_string(line.get_value_for(2), type)) {
+				ret = false;
+				return;
+			}
+			Province const* through = get_province_by_identifier(line.get_value_for(3));
+			if (through == nullptr &&
+				(type == Province::adjacency_t::type_t::SEA || type == Province::adjacency_t::type_t::CANAL)) {
+				Logger::warning(
+					"Adjacency from ", from_identifier, " to ", to_identifier, " has invalid through province \"",
+					line.get_value_for(3), "\""
+				);
+			}
+			const std::string_view data_string = line.get_value_for(4);
+			bool successful = data_string.empty();
+			const uint64_t data =
+				successful ? 0 : StringUtils::string_to_uint64(data_string.data(), data_string.size(), &successful);
+			if (!successful || data > std::numeric_limits<Province::flags_t>::max()) {
+				Logger::warning(
+					"Skipping adjacency from ", from_identifier, " to ", to_identifier, " with invalid data \"", data_string,
+					"\""
+				);
+				return;
+			}
+			special_edges.push_back({
+				_make_adjacency_key(from->get_index(), to->get_index()),
+				through != nullptr ? through->get_index() : Province::NULL_INDEX, static_cast<Province::flags_t>(data), type
+			});
+		}
+	);
+
+	/* Special adjacencies replace the edges they match, with the last line for any pair taking priority. */
+	std::stable_sort(
+		special_edges.begin(), special_edges.end(), [](adjacency_edge_t const& a, adjacency_edge_t const& b) -> bool {
+			return a.key < b.key;
+		}
+	);
+	const size_t shape_edge_count = edges.size();
+	for (size_t idx = 0; idx < special_edges.size(); ++idx) {
+		if (idx + 1 < special_edges.size() && special_edges[idx + 1].key == special_edges[idx].key) {
+			continue;
+		}
+		const std::vector<adjacency_edge_t>::iterator it = std::lower_bound(
+			edges.begin(), edges.begin() + shape_edge_count, special_edges[idx].key,
+			[](adjacency_edge_t const& edge, uint32_t key) -> bool {
+				return edge.key < key;
+			}
+		);
+		if (it != edges.begin() + shape_edge_count && it->key == special_edges[idx].key) {
+			*it = special_edges[idx];
+		} else {
+			edges.push_back(special_edges[idx]);
+		}
+	}
+	std::inplace_merge(
+		edges.begin(), edges.begin() + shape_edge_count, edges.end(),
+		[](adjacency_edge_t const& a, adjacency_edge_t const& b) -> bool {
+			return a.key < b.key;
+		}
+	);
+	return ret;
+}
+
+void Map::_build_adjacency_graph(std::vector<adjacency_edge_t> const& edges) {
+	/* Each edge appears once in the row of each of its provinces. Sorting the directed entries, packed as
+	 * (from << 48) | (to << 32) | edge index, lays out the rows in order, each sorted by destination. */
+	std::vector<uint64_t> directed_edges;
+	directed_edges.reserve(edges.size() * 2);
+	for (size_t idx = 0; idx < edges.size(); ++idx) {
+		const uint64_t lower = edges[idx].key >> 16, higher = edges[idx].key & 0xFFFF;
+		directed_edges.push_back((lower << 48) | (higher << 32) | idx);
+		directed_edges.push_back((higher << 48) | (lower << 32) | idx);
+	}
+	std::sort(directed_edges.begin(), directed_edges.end());
+
+	adjacencies.clear();
+	adjacencies.reserve(directed_edges.size());
+	adjacency_offsets.assign(provinces.size(), 0);
+	for (const uint64_t directed_edge : directed_edges) {
+		adjacency_edge_t const& edge = edges[directed_edge & 0xFFFFFFFF];
+		adjacencies.push_back({
+			static_cast<Province::index_t>((directed_edge >> 32) & 0xFFFF), edge.through, 0, edge.flags, edge.type
+		});
+		adjacency_offsets[(directed_edge >> 48) - 1]++;
+	}
+	size_t row_begin = 0;
+	for (uint32_t& offset : adjacency_offsets) {
+		row_begin += offset;
+		offset = row_begin;
+	}
+	_assign_province_adjacencies();
+}
+
+void Map::_assign_province_adjacencies() {
+	size_t row_begin = 0;
+	for (size_t idx = 0; idx < adjacency_offsets.size(); ++idx) {
+		const size_t row_end = adjacency_offsets[idx];
+		provinces.get_item_by_index(idx)->adjacencies = { adjacencies.data() + row_begin, adjacencies.data() + row_end };
+		row_begin = row_end;
+	}
 }
 
 bool Map::generate_and_load_province_adjacencies(std::vector<ovdl::csv::LineObject> const& additional_adjacencies) {
-	bool ret = _generate_province_adjacencies();
-	// TODO - DEV TASK: read additional adjacencies
-	for (ovdl::csv::LineObject special_adjacency : additional_adjacencies)
-	{	
-		Province* from = get_province_by_identifier(special_adjacency.get_value_for(0));
-		Province* to = get_province_by_identifier(special_adjacency.get_value_for(1));
-		Province::ajacency_t::type_t type = Province::get_adjacency_type_from_string(special_adjacency.get_value_for(2));
-		Province* through = get_province_by_identifier(special_adjacency.get_value_for(3));
-		Province::flags_t data = (uint16_t)special_adjacency.get_value_for(4);
-		from->add_special_adjacency(to, 0, data, type, through);
+	OV_PROFILE_SCOPE("Map::generate_and_load_province_adjacencies");
+	if (!provinces.is_locked()) {
+		Logger::error("Province adjacencies cannot be generated until after provinces are locked!");
+		return false;
 	}
+	/* Every pair of provinces sharing a border is adjacent. */
+	std::vector<adjacency_edge_t> edges;
+	edges.reserve(border_keys.size());
+	for (const uint32_t key : border_keys) {
+		edges.push_back({ key, Province::NULL_INDEX, 0, Province::adjacency_t::type_t::STANDARD });
+	}
+	bool ret = _apply_special_adjacencies(edges, additional_adjacencies);
+	_build_adjacency_graph(edges);
+	Logger::info("Generated ", edges.size(), " province adjacencies");
+	ret &= pathfinder.generate();
 	return ret;
 }
+
+bool Map::save_map_cache(fs::path const& cache_path, uint64_t source_key) const {
+	OV_PROFILE_SCOPE("Map::save_map_cache");
+	static_assert(
+		std::is_trivially_copyable_v<shape_pixel_t> && std::is_trivially_copyable_v<Province::adjacency_t> &&
+		std::is_trivially_copyable_v<Province::shape_geometry_t>
+	);
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(
+		width * height * sizeof(shape_pixel_t) + adjacencies.size() * sizeof(Province::adjacency_t) +
+		provinces.size() * (16 + sizeof(Province::shape_geometry_t)) + border_keys.size() * 8 + border_segments.size() * 13 +
+		64
+	);
+	BinaryWriter writer { buffer };
+	writer.write(MAP_CACHE_MAGIC);
+	writer.write(MAP_CACHE_VERSION);
+	writer.write(source_key);
+	writer.write<uint32_t>(sizeof(shape_pixel_t));
+	writer.write<uint32_t>(sizeof(Province::adjacency_t));
+	writer.write<uint32_t>(provinces.size());
+	writer.write<uint32_t>(terrain_type_manager.get_terrain_type_count());
+	writer.write<uint64_t>(width);
+	writer.write<uint64_t>(height);
+	/* The cache always holds raw rows, so it can be loaded into either storage. */
+	std::vector<shape_pixel_t> row(width);
+	for (size_t y = 0; y < height; ++y) {
+		province_shape_image.get_row(y, row.data());
+		writer.write_bytes(row.data(), row.size() * sizeof(shape_pixel_t));
+	}
+	for (Province const& province : provinces.get_items()) {
+		writer.write_index(terrain_type_manager.get_terrain_types(), province.get_default_terrain_type());
+		writer.write<uint8_t>(province.get_on_map());
+		writer.write(province.get_shape_geometry());
+	}
+	writer.write<uint32_t>(adjacencies.size());
+	writer.write_bytes(adjacencies.data(), adjacencies.size() * sizeof(Province::adjacency_t));
+	writer.write_bytes(adjacency_offsets.data(), adjacency_offsets.size() * sizeof(uint32_t));
+	writer.write<uint32_t>(border_keys.size());
+	writer.write<uint32_t>(border_segments.size());
+	writer.write_bytes(border_keys.data(), border_keys.size() * sizeof(uint32_t));
+	writer.write_bytes(border_offsets.data(), border_offsets.size() * sizeof(uint32_t));
+	/* Written field by field, so no padding or out of range bool values end up in the file. */
+	for (border_segment_t const& segment : border_segments) {
+		writer.write(segment.x);
+		writer.write(segment.y);
+		writer.write(segment.length);
+		writer.write<uint8_t>(segment.vertical);
+	}
+
+	std::error_code error_code;
+	fs::create_directories(cache_path.parent_path(), error_code);
+	fs::path temporary_path = cache_path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream file { temporary_path, std::ios::binary | std::ios::trunc };
+		file.write(reinterpret_cast<char const*>(buffer.data()), buffer.size());
+		if (file.fail()) {
+			Logger::error("Failed to write map cache file \"", temporary_path, "\"");
+			file.close();
+			fs::remove(temporary_path, error_code);
+			return false;
+		}
+	}
+	fs::rename(temporary_path, cache_path, error_code);
+	if (error_code) {
+		Logger::error("Failed to move map cache file to \"", cache_path, "\": ", error_code.message());
+		fs::remove(temporary_path, error_code);
+		return false;
+	}
+	Logger::info("Saved ", buffer.size(), " byte map cache to \"", cache_path, "\"");
+	return true;
+}
+
+bool Map::load_map_cache(fs::path const& cache_path, uint64_t source_key) {
+	OV_PROFILE_SCOPE("Map::load_map_cache");
+	if (!provinces.is_locked()) {
+		Logger::error("Map cache cannot be loaded until after provinces are locked!");
+		return false;
+	}
+	if (!terrain_type_manager.terrain_types_are_locked()) {
+		Logger::error("Map cache cannot be loaded until after terrain types are locked!");
+		return false;
+	}
+	std::error_code error_code;
+	if (!fs::is_regular_file(cache_path, error_code)) {
+		Logger::info("No map cache found at \"", cache_path, "\"");
+		return false;
+	}
+	MappedFile file;
+	if (!file.open(cache_path)) {
+		return false;
+	}
+	BinaryReader reader { file.get_data() };
+
+	uint32_t magic, version, pixel_size, adjacency_size, province_count, terrain_type_count;
+	uint64_t file_source_key, file_width, file_height;
+	if (!(
+		reader.read(magic) && reader.read(version) && reader.read(file_source_key) && reader.read(pixel_size) &&
+		reader.read(adjacency_size) && reader.read(province_count) && reader.read(terrain_type_count) &&
+		reader.read(file_width) && reader.read(file_height)
+	)) {
+		Logger::warning("Map cache \"", cache_path, "\" is truncated");
+		return false;
+	}
+	if (magic != MAP_CACHE_MAGIC || version != MAP_CACHE_VERSION || pixel_size != sizeof(shape_pixel_t) ||
+		adjacency_size != sizeof(Province::adjacency_t)) {
+		Logger::info("Map cache \"", cache_path, "\" was made by a different build, ignoring it");
+		return false;
+	}
+	if (file_source_key != source_key || province_count != provinces.size() ||
+		terrain_type_count != terrain_type_manager.get_terrain_type_count()) {
+		Logger::info("Map cache \"", cache_path, "\" is out of date, ignoring it");
+		return false;
+	}
+	if (file_width == 0 || file_height == 0 || file_width > reader.get_remaining() / file_height / sizeof(shape_pixel_t)) {
+		Logger::warning("Map cache \"", cache_path, "\" has invalid dimensions ", file_width, "x", file_height);
+		return false;
+	}
+
+	ProvinceShapeImage new_shape_image;
+	new_shape_image.reset(file_width, file_height, province_shape_storage);
+	std::vector<shape_pixel_t> row(file_width);
+	for (size_t y = 0; y < file_height; ++y) {
+		if (!reader.read_bytes(row.data(), row.size() * sizeof(shape_pixel_t))) {
+			return false;
+		}
+		/* A corrupt cache must not be able to produce out of range province indices. */
+		for (shape_pixel_t const& pixel : row) {
+			if (pixel.index > province_count) {
+				Logger::warning("Map cache \"", cache_path, "\" contains invalid province index ", pixel.index);
+				return false;
+			}
+		}
+		new_shape_image.append_row(row);
+	}
+
+	struct province_terrain_t {
+		TerrainType const* default_terrain_type;
+		bool on_map;
+		Province::shape_geometry_t shape_geometry;
+	};
+	std::vector<province_terrain_t> province_terrains(province_count);
+	for (province_terrain_t& province_terrain : province_terrains) {
+		uint8_t on_map;
+		if (!(
+			reader.read_index(terrain_type_manager.get_terrain_types(), province_terrain.default_terrain_type) &&
+			reader.read(on_map) && reader.read(province_terrain.shape_geometry)
+		)) {
+			return false;
+		}
+		province_terrain.on_map = on_map != 0;
+		Province::shape_geometry_t const& geometry = province_terrain.shape_geometry;
+		if (province_terrain.on_map != (geometry.pixel_area > 0) || (province_terrain.on_map && (
+			geometry.bounds_min.x < 0 || geometry.bounds_min.y < 0 || geometry.bounds_min.x > geometry.bounds_max.x ||
+			geometry.bounds_min.y > geometry.bounds_max.y || static_cast<uint64_t>(geometry.bounds_max.x) >= file_width ||
+			static_cast<uint64_t>(geometry.bounds_max.y) >= file_height
+		))) {
+			Logger::warning("Map cache \"", cache_path, "\" contains invalid province geometry");
+			return false;
+		}
+	}
+
+	uint32_t adjacency_count;
+	if (!reader.read(adjacency_count) || adjacency_count > reader.get_remaining() / sizeof(Province::adjacency_t)) {
+		Logger::warning("Map cache \"", cache_path, "\" has an invalid adjacency count");
+		return false;
+	}
+	std::vector<Province::adjacency_t> new_adjacencies;
+	new_adjacencies.reserve(adjacency_count);
+	for (uint32_t idx = 0; idx < adjacency_count; ++idx) {
+		Province::adjacency_t adjacency { Province::NULL_INDEX, Province::NULL_INDEX, 0, 0, {} };
+		if (!reader.read(adjacency)) {
+			return false;
+		}
+		if (adjacency.get_to() == Province::NULL_INDEX || adjacency.get_to() > province_count ||
+			adjacency.get_through() > province_count || adjacency.get_type() > Province::adjacency_t::type_t::CANAL) {
+			Logger::warning("Map cache \"", cache_path, "\" contains an invalid adjacency");
+			return false;
+		}
+		new_adjacencies.push_back(adjacency);
+	}
+	std::vector<uint32_t> new_adjacency_offsets(province_count);
+	if (!reader.read_bytes(new_adjacency_offsets.data(), new_adjacency_offsets.size() * sizeof(uint32_t))) {
+		return false;
+	}
+	if (!std::is_sorted(new_adjacency_offsets.begin(), new_adjacency_offsets.end()) ||
+		(!new_adjacency_offsets.empty() && new_adjacency_offsets.back() != adjacency_count)) {
+		Logger::warning("Map cache \"", cache_path, "\" has invalid adjacency offsets");
+		return false;
+	}
+
+	uint32_t border_key_count, border_segment_count;
+	if (!(reader.read(border_key_count) && reader.read(border_segment_count)) ||
+		border_key_count > reader.get_remaining() / (2 * sizeof(uint32_t)) ||
+		border_segment_count > reader.get_remaining() / 13) {
+		Logger::warning("Map cache \"", cache_path, "\" has invalid border counts");
+		return false;
+	}
+	std::vector<uint32_t> new_border_keys(border_key_count), new_border_offsets(border_key_count);
+	if (!(
+		reader.read_bytes(new_border_keys.data(), new_border_keys.size() * sizeof(uint32_t)) &&
+		reader.read_bytes(new_border_offsets.data(), new_border_offsets.size() * sizeof(uint32_t))
+	)) {
+		return false;
+	}
+	for (size_t idx = 0; idx < border_key_count; ++idx) {
+		const uint32_t lower = new_border_keys[idx] >> 16, higher = new_border_keys[idx] & 0xFFFF;
+		if (lower == Province::NULL_INDEX || lower >= higher || higher > province_count ||
+			(idx > 0 && new_border_keys[idx - 1] >= new_border_keys[idx]) ||
+			new_border_offsets[idx] <= (idx > 0 ? new_border_offsets[idx - 1] : 0)) {
+			Logger::warning("Map cache \"", cache_path, "\" contains an invalid border");
+			return false;
+		}
+	}
+	if (!new_border_offsets.empty() ? new_border_offsets.back() != border_segment_count : border_segment_count != 0) {
+		Logger::warning("Map cache \"", cache_path, "\" has invalid border offsets");
+		return false;
+	}
+	std::vector<border_segment_t> new_border_segments(border_segment_count);
+	for (border_segment_t& segment : new_border_segments) {
+		uint8_t vertical;
+		if (!(reader.read(segment.x) && reader.read(segment.y) && reader.read(segment.length) && reader.read(vertical))) {
+			return false;
+		}
+		segment.vertical = vertical != 0;
+		const uint64_t end = static_cast<uint64_t>(segment.vertical ? segment.y : segment.x) + segment.length;
+		if (segment.length == 0 || end > (segment.vertical ? file_height : file_width) ||
+			(segment.vertical ? segment.x >= file_width : segment.y == 0 || segment.y >= file_height)) {
+			Logger::warning("Map cache \"", cache_path, "\" contains an invalid border segment");
+			return false;
+		}
+	}
+	if (!reader.at_end()) {
+		Logger::warning("Map cache \"", cache_path, "\" has trailing data");
+		return false;
+	}
+
+	width = file_width;
+	height = file_height;
+	province_shape_image = std::move(new_shape_image);
+	for (size_t idx = 0; idx < province_terrains.size(); ++idx) {
+		Province* province = provinces.get_item_by_index(idx);
+		province->default_terrain_type = province_terrains[idx].default_terrain_type;
+		province->on_map = province_terrains[idx].on_map;
+		province->shape_geometry = province_terrains[idx].shape_geometry;
+	}
+	border_keys = std::move(new_border_keys);
+	border_offsets = std::move(new_border_offsets);
+	border_segments = std::move(new_border_segments);
+	adjacencies = std::move(new_adjacencies);
+	adjacency_offsets = std::move(new_adjacency_offsets);
+	_assign_province_adjacencies();
+	Logger::info("Loaded map cache from \"", cache_path, "\" with ", adjacencies.size() / 2, " province adjacencies");
+	return pathfinder.generate();
+}
@@ -1,12 +1,24 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <functional>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
 
 #include <openvic-dataloader/csv/LineObject.hpp>
 
+#include "openvic-simulation/map/Pathfinding.hpp"
+#include "openvic-simulation/map/ProvinceShapeImage.hpp"
+#include "openvic-simulation/map/ProvinceState.hpp"
 #include "openvic-simulation/map/Region.hpp"
 #include "openvic-simulation/map/TerrainType.hpp"
+#include "openvic-simulation/pop/PopStore.hpp"
+#include "openvic-simulation/types/ColourIndexMap.hpp"
+#include "openvic-simulation/types/TournamentTree.hpp"
+#include "openvic-simulation/utility/ThreadPool.hpp"
 
 namespace OpenVic {
 	namespace fs = std::filesystem;
@@ -18,13 +30,29 @@ namespace OpenVic {
 		 * controlling interpolation with the terrain colour (0 = all terrain, 255 = all corresponding RGB) */
 		using base_stripe_t = uint64_t;
 		using colour_func_t = std::function<base_stripe_t(Map const&, Province const&)>;
+		/* Colours a contiguous range of provinces, writing one entry per province to target. */
+		using batch_func_t = std::function<void(Map const&, std::span<const Province>, base_stripe_t*)>;
 		using index_t = size_t;
 
 	private:
 		const index_t PROPERTY(index);
 		const colour_func_t colour_func;
+		/* Set for mapmodes added with a kernel type, which is inlined into the loop over the range so colouring many
+		 * provinces costs a single indirect call. Null for mapmodes only defined by a colour_func_t, e.g. from scripts. */
+		const batch_func_t batch_func;
+		/* Whether colours depend on map-wide state, such as the highest province population or the region and owner
+		 * population totals, rather than only on the province's own state. If so, every province's colour is
+		 * recalculated when any of the map's population aggregates change, rather than only those of the provinces
+		 * which were updated. */
+		const bool PROPERTY(uses_map_state);
+		/* Whether provinces may be coloured concurrently from multiple threads, splitting large batches across the
+		 * thread pool. */
+		const bool PROPERTY(thread_safe);
 
-		Mapmode(std::string_view new_identifier, index_t new_index, colour_func_t new_colour_func);
+		Mapmode(
+			std::string_view new_identifier, index_t new_index, colour_func_t&& new_colour_func, batch_func_t&& new_batch_func,
+			bool new_uses_map_state, bool new_thread_safe
+		);
 
 	public:
 		static const Mapmode ERROR_MAPMODE;
@@ -32,6 +60,7 @@ namespace OpenVic {
 		Mapmode(Mapmode&&) = default;
 
 		base_stripe_t get_base_stripe_colours(Map const& map, Province const& province) const;
+		void get_base_stripe_colours(Map const& map, std::span<const Province> provinces, base_stripe_t* target) const;
 	};
 
 	struct GoodManager;
@@ -42,35 +71,152 @@ namespace OpenVic {
 	 */
 	struct Map {
 
-#pragma pack(push, 1)
-		/* Used to represent tightly packed 3-byte integer pixel information. */
-		struct shape_pixel_t {
+		using shape_pixel_t = ProvinceShapeImage::pixel_t;
+		struct mapmode_colour_change_t {
 			Province::index_t index;
-			TerrainTypeMapping::index_t terrain;
+			Mapmode::base_stripe_t base_stripe;
 		};
-#pragma pack(pop)
+		/* A straight stretch of the border between two provinces, along pixel edges. Horizontal segments run along the
+		 * top edge of row y from x to x + length, and vertical ones along the left edge of column x from y to y + length,
+		 * with column 0's left edge being the last column's right edge as the map wraps around horizontally. */
+		struct border_segment_t {
+			uint32_t x, y, length;
+			bool vertical;
+		};
+		/* The constants of the monthly demographic update, from the pops section of the defines. A province's monthly
+		 * growth rate is base_growth, plus life_rating_growth_bonus for each point of life rating above (or minus for each
+		 * point below) min_life_rating_for_growth, plus its population growth modifier. */
+		struct demographic_defines_t {
+			fixed_point_t base_growth;
+			fixed_point_t life_rating_growth_bonus;
+			Province::life_rating_t min_life_rating_for_growth;
+			fixed_point_t promotion_scale;
+			fixed_point_t migration_scale;
+		};
+
 	private:
-		using colour_index_map_t = std::map<colour_t, Province::index_t>;
+		using colour_index_map_t = ColourIndexMap<Province::index_t>;
+
+		/* Each province's colour in a mapmode, as of a given map state version. */
+		struct mapmode_cache_t {
+			/* The state version the cache was last brought up to date with, 0 if it has never been filled. */
+			uint64_t state_version = 0;
+			std::vector<Mapmode::base_stripe_t> colours;
+			/* The state version at which each province's colour last changed. */
+			std::vector<uint64_t> colour_versions;
+		};
+
+		/* Number of provinces handed to a thread pool worker at a time when ticking or updating the map. */
+		static constexpr size_t PROVINCE_CHUNK_SIZE = 64;
+		static constexpr size_t MAPMODE_WRITE_CHUNK_SIZE = 4096;
+		/* Number of provinces whose pops a thread pool worker updates at a time in update_demographics. */
+		static constexpr size_t DEMOGRAPHICS_PROVINCE_CHUNK_SIZE = 256;
 
+		ThreadPool& thread_pool;
 		IdentifierRegistry<Province> provinces;
+		ProvinceState province_state;
+		PopStore pop_store;
+		/* Scratch space for update_demographics, indexed by province index. */
+		std::vector<PopStore::demographic_rates_t> demographic_rates;
 		IdentifierRegistry<Region> regions;
 		IdentifierRegistry<Mapmode> mapmodes;
 		ProvinceSet water_provinces;
 		TerrainTypeManager terrain_type_manager;
 
 		size_t width = 0, height = 0;
-		std::vector<shape_pixel_t> province_shape_image;
-		colour_index_map_t colour_index_map;
+		ProvinceShapeImage province_shape_image;
+		/* How the next shape image loaded will be stored. */
+		ProvinceShapeImage::storage_t PROPERTY_RW(province_shape_storage);
+		/* The modifier effect summed over each province's terrain and buildings into its population growth modifier, or
+		 * nullptr to leave every province's modifier at 0. */
+		ModifierEffect const* PROPERTY_RW(population_growth_effect);
+
+		/* Province adjacency graph in compressed sparse row form. adjacency_offsets holds the end of each province's row
+		 * in registry order, so the province with index i has adjacencies from adjacency_offsets[i - 2] (or 0 when i is 1)
+		 * up to but not including adjacency_offsets[i - 1]. Each row is sorted by destination index. */
+		std::vector<Province::adjacency_t> adjacencies;
+		std::vector<uint32_t> adjacency_offsets;
+		/* Border segments between every pair of provinces touching in the shape image, grouped by pair. border_keys holds
+		 * the pairs' sorted adjacency keys, with the segments of the pair with key border_keys[i] running from
+		 * border_offsets[i - 1] (or 0 when i is 0) up to but not including border_offsets[i]. Each pair's segments are
+		 * sorted horizontal first, then by the line they lie on and their start along it. */
+		std::vector<uint32_t> border_keys;
+		std::vector<uint32_t> border_offsets;
+		std::vector<border_segment_t> border_segments;
+		ProvincePathfinder pathfinder;
+		colour_index_map_t colour_index_map { Province::NULL_INDEX };
 
 		Province::index_t max_provinces = Province::MAX_INDEX;
 		Province::index_t selected_province = Province::NULL_INDEX;
-		Pop::pop_size_t highest_province_population, total_map_population;
+
+		/* Population aggregates, adjusted by the change in each recalculated province's population and owner rather than
+		 * recounted from every province. The tree's leaves are the populations the provinces were last counted with,
+		 * in registry order, and counted_owners their owners at the time. */
+		TournamentTree<Pop::pop_size_t> province_populations;
+		std::vector<Country const*> counted_owners;
+		Pop::pop_size_t total_map_population = 0;
+		/* Indexed by region registry index, only counting the provinces of non-meta regions. */
+		std::vector<Pop::pop_size_t> region_populations;
+		std::unordered_map<Country const*, Pop::pop_size_t> owner_populations;
+		/* The state version at which any of the population aggregates last changed. */
+		uint64_t map_aggregates_version = 0;
+
+		/* Moves a province's population in the aggregates from the value and owner it was last counted with to its
+		 * current ones. Returns whether any aggregate changed. */
+		bool _count_province_population(Province const& province);
+		void _recount_population_aggregates();
+
+		/* One bit per province (bit index = province index - 1), set when the province needs to be recalculated on the
+		 * next state update. Atomic so provinces can flag themselves from thread pool workers. */
+		std::vector<std::atomic<uint64_t>> dirty_provinces;
+		std::vector<Province::index_t> dirty_province_list;
+
+		void _collect_dirty_provinces();
+
+		/* Incremented by every state update which recalculates any provinces. Starts at 1 so that 0 is older than
+		 * every version. */
+		uint64_t state_version = 1;
+		/* The state version at which each province was last recalculated, indexed by province index - 1. */
+		std::vector<uint64_t> province_state_versions;
+		mutable std::mutex mapmode_cache_mutex;
+		mutable std::vector<mapmode_cache_t> mapmode_caches;
+		mutable std::vector<Mapmode::base_stripe_t> mapmode_colour_buffer;
+
+		/* Brings the mapmode's cache up to date with the current state version. mapmode_cache_mutex must be held. */
+		mapmode_cache_t const& _update_mapmode_cache(Mapmode const& mapmode) const;
 
 		Province::index_t get_index_from_colour(colour_t colour) const;
-		bool _generate_province_adjacencies();
+		/* Number of row bands to split the shape image into when processing it on the thread pool. */
+		size_t _get_image_band_count() const;
+
+		/* An undirected adjacency, between provinces with indices (key >> 16) and (key & 0xFFFF), the former lower. */
+		struct adjacency_edge_t {
+			uint32_t key;
+			Province::index_t through;
+			Province::flags_t flags;
+			Province::adjacency_t::type_t type;
+		};
+		static constexpr uint32_t _make_adjacency_key(Province::index_t a, Province::index_t b) {
+			return a < b ? (static_cast<uint32_t>(a) << 16) | b : (static_cast<uint32_t>(b) << 16) | a;
+		}
+
+		/* 0 unless a and b are different provinces, so the pixels are on a border. */
+		static constexpr uint32_t _make_border_key(Province::index_t a, Province::index_t b) {
+			return a != Province::NULL_INDEX && b != Province::NULL_INDEX && a != b ? _make_adjacency_key(a, b) : 0;
+		}
+
+		/* Traces the borders between every pair of provinces touching in the shape image, filling in border_keys,
+		 * border_offsets and border_segments. */
+		void _find_shape_image_borders();
+		bool _apply_special_adjacencies(
+			std::vector<adjacency_edge_t>& edges, std::vector<ovdl::csv::LineObject> const& additional_adjacencies
+		) const;
+		void _build_adjacency_graph(std::vector<adjacency_edge_t> const& edges);
+		/* Points each province's adjacency span at its row of the adjacency graph. */
+		void _assign_province_adjacencies();
 
 	public:
-		Map();
+		Map(ThreadPool& new_thread_pool);
 
 		bool add_province(std::string_view identifier, colour_t colour);
 		IDENTIFIER_REGISTRY_ACCESSORS(province)
@@ -84,22 +230,70 @@ namespace OpenVic {
 		Province* get_province_by_index(Province::index_t index);
 		Province const* get_province_by_index(Province::index_t index) const;
 		Province::index_t get_province_index_at(size_t x, size_t y) const;
+		/* Batched form of get_province_index_at for callers with many points at once, such as hover and sampling
+		 * queries from the frontend. Writes the province index at each (xs[i], ys[i]) to indices[i] and, if terrains is
+		 * not empty, the shape image terrain texture index there to terrains[i], with NULL_INDEX and 0 for points outside
+		 * the map. The shape image is not changed after loading, so this is safe to call from any thread while the
+		 * simulation is running. */
+		bool get_province_indices_at(
+			std::span<const int32_t> xs, std::span<const int32_t> ys, std::span<Province::index_t> indices,
+			std::span<TerrainTypeMapping::index_t> terrains = {}
+		) const;
 		bool set_max_provinces(Province::index_t new_max_provinces);
 		Province::index_t get_max_provinces() const;
+		void mark_province_dirty(Province::index_t index);
+		void mark_all_provinces_dirty();
 		void set_selected_province(Province::index_t index);
 		Province::index_t get_selected_province_index() const;
 		Province const* get_selected_province() const;
 
 		size_t get_width() const;
 		size_t get_height() const;
+		/* Empty unless the shape image uses RAW storage, otherwise use get_province_shape to expand regions of it. */
 		std::vector<shape_pixel_t> const& get_province_shape_image() const;
+		ProvinceShapeImage const& get_province_shape() const;
+		std::vector<Province::adjacency_t> const& get_adjacencies() const;
+		std::vector<uint32_t> const& get_adjacency_offsets() const;
+		/* The segments of the border between two provinces, empty if they do not touch in the shape image. */
+		std::span<const border_segment_t> get_border_segments(Province const& a, Province const& b) const;
+		std::vector<border_segment_t> const& get_all_border_segments() const;
+		REF_GETTERS(pathfinder)
+		REF_GETTERS(province_state)
+		REF_GETTERS(pop_store)
 		REF_GETTERS(terrain_type_manager)
 
 		bool add_region(std::string_view identifier, std::vector<std::string_view> const& province_identifiers);
 		IDENTIFIER_REGISTRY_ACCESSORS(region)
 		IDENTIFIER_REGISTRY_NON_CONST_ACCESSORS(region)
 
-		bool add_mapmode(std::string_view identifier, Mapmode::colour_func_t colour_func);
+	private:
+		bool _add_mapmode(
+			std::string_view identifier, Mapmode::colour_func_t&& colour_func, Mapmode::batch_func_t&& batch_func,
+			bool uses_map_state, bool thread_safe
+		);
+
+	public:
+		/* Fallback for mapmodes only known at runtime. Each province's colour goes through the type-erased colour_func,
+		 * which is only called from multiple threads at once if thread_safe is set. */
+		bool add_mapmode(
+			std::string_view identifier, Mapmode::colour_func_t colour_func, bool uses_map_state = true,
+			bool thread_safe = false
+		);
+		/* Fast path for mapmodes known at compile time. The kernel is inlined into a loop writing each province's
+		 * base_stripe_t straight to the output, so the compiler can optimise across provinces. Kernels must only read
+		 * the map and province they are given, so they are always run in parallel. */
+		template<typename Kernel>
+		requires std::is_invocable_r_v<Mapmode::base_stripe_t, Kernel const&, Map const&, Province const&>
+		bool add_mapmode(std::string_view identifier, Kernel kernel, bool uses_map_state = true) {
+			Mapmode::batch_func_t batch_func = [kernel](
+				Map const& map, std::span<const Province> range, Mapmode::base_stripe_t* target
+			) {
+				for (Province const& province : range) {
+					*target++ = kernel(map, province);
+				}
+			};
+			return _add_mapmode(identifier, std::move(kernel), std::move(batch_func), uses_map_state, true);
+		}
 		IDENTIFIER_REGISTRY_ACCESSORS(mapmode)
 		Mapmode const* get_mapmode_by_index(size_t index) const;
 
@@ -109,22 +303,66 @@ namespace OpenVic {
 		 * together adjacently, so each province's entry is 8 bytes long. The list contains Province::MAX_INDEX + 1 entries,
 		 * that is the maximum allowed number of provinces plus one for the index-zero "null province". */
 		bool generate_mapmode_colours(Mapmode::index_t index, uint8_t* target) const;
+		/* Colours are cached per mapmode and only recalculated for provinces updated since they were last requested,
+		 * with each colour stamped with the state version at which it last changed. This appends to changes every
+		 * province whose colour has changed since since_version, in index order, and sets current_version to the
+		 * version to pass next time. A since_version of 0 returns every province, so a renderer can patch its colour
+		 * texture with the changes rather than regenerating all of it. */
+		bool get_mapmode_colour_changes(
+			Mapmode::index_t index, uint64_t since_version, std::vector<mapmode_colour_change_t>& changes,
+			uint64_t& current_version
+		) const;
+		uint64_t get_state_version() const;
 
 		bool reset(BuildingManager const& building_manager);
 		bool apply_history_to_provinces(ProvinceHistoryManager const& history_manager, Date date);
 
-		void update_highest_province_population();
+		void save_snapshot(
+			BinaryWriter& writer, CountryManager const& country_manager, GoodManager const& good_manager,
+			PopManager const& pop_manager
+		) const;
+		/* Restores every province from the snapshot and marks them all dirty, so the next state update brings the
+		 * derived province values and map aggregates back in line. */
+		bool load_snapshot(
+			BinaryReader& reader, CountryManager const& country_manager, GoodManager const& good_manager,
+			PopManager const& pop_manager
+		);
+
 		Pop::pop_size_t get_highest_province_population() const;
-		void update_total_map_population();
+		/* Null if there are no provinces, otherwise the first province with the highest population. */
+		Province const* get_most_populous_province() const;
 		Pop::pop_size_t get_total_map_population() const;
+		/* 0 for meta regions, which provinces are not counted towards as they may overlap other regions. */
+		Pop::pop_size_t get_region_population(Region const& region) const;
+		Pop::pop_size_t get_owner_population(Country const* owner) const;
 
 		void update_state(Date today);
-		void tick(Date today);
+		/* Applies a month of growth to every pop and sets their promotion, demotion and migration counters, marking the
+		 * provinces with pops dirty so the next state update picks up their new sizes. */
+		void update_demographics(demographic_defines_t const& defines);
+		/* Merges small pops and splits oversized ones in every province, see PopStore::consolidate_province, marking
+		 * the provinces which changed dirty. */
+		void consolidate_pops();
 
 		bool load_province_definitions(std::vector<ovdl::csv::LineObject> const& lines);
 		bool load_province_positions(BuildingManager const& building_manager, ast::NodeCPtr root);
 		bool load_region_file(ast::NodeCPtr root);
 		bool load_map_images(fs::path const& province_path, fs::path const& terrain_path, bool detailed_errors);
 		bool generate_and_load_province_adjacencies(std::vector<ovdl::csv::LineObject> const& additional_adjacencies);
+
+		/* The map cache holds everything load_map_images and generate_and_load_province_adjacencies derive from the map
+		 * images and adjacencies file: the province shape image, each province's default terrain type, on_map flag and
+		 * shape geometry, the border segments and the adjacency graph. It is keyed on source_key, which should identify
+		 * the contents of every source file they depend on, and like snapshots is only meant to be read back by the same
+		 * build on the same platform. */
+		static constexpr uint32_t MAP_CACHE_MAGIC = 0x434D564F; // "OVMC"
+		static constexpr uint32_t MAP_CACHE_VERSION = 2;
+
+		/* Written to a temporary file which then replaces cache_path, so concurrent readers never see a partial cache. */
+		bool save_map_cache(fs::path const& cache_path, uint64_t source_key) const;
+		/* Can be used instead of load_map_images and generate_and_load_province_adjacencies once provinces and terrain
+		 * types are loaded. Returns false, leaving the map's image and adjacency data untouched, if the cache is
+		 * missing, was made from different sources or is invalid. */
+		bool load_map_cache(fs::path const& cache_path, uint64_t source_key);
 	};
 }
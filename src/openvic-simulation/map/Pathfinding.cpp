@@ -0,0 +1,349 @@
+#include "Pathfinding.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "openvic-simulation/map/Map.hpp"
+#include "openvic-simulation/utility/Logger.hpp"
+#include "openvic-simulation/utility/Profiler.hpp"
+
+using namespace OpenVic;
+
+using cost_t = ProvincePathfinder::cost_t;
+
+static constexpr cost_t INFINITE_COST = std::numeric_limits<cost_t>::infinity();
+/* Every adjacency costs at least this much, so provinces without positions still add to a path's length. */
+static constexpr cost_t MIN_EDGE_COST = 1.0f;
+/* Number of queries handed to a thread pool worker at a time by find_paths. */
+static constexpr size_t QUERY_CHUNK_SIZE = 16;
+
+bool ProvincePathfinder::filter_t::can_use(
+	Province::adjacency_t const& adjacency, Province const& to, Province const* through, bool is_goal
+) const {
+	using enum Province::adjacency_t::type_t;
+
+	if (adjacency.get_type() == IMPASSABLE) {
+		return false;
+	}
+	if (movement == movement_t::LAND) {
+		if (to.get_water() || adjacency.get_type() == CANAL) {
+			return false;
+		}
+		if (adjacency.get_type() == SEA) {
+			if (!allow_straits || (through != nullptr && can_cross_strait && !can_cross_strait(*through))) {
+				return false;
+			}
+		}
+	} else {
+		if ((!to.get_water() && !is_goal) || adjacency.get_type() == SEA) {
+			return false;
+		}
+		if (adjacency.get_type() == CANAL) {
+			if (!allow_canals || (through != nullptr && can_enter && !can_enter(*through))) {
+				return false;
+			}
+		}
+	}
+	return !can_enter || can_enter(to);
+}
+
+ProvincePathfinder::ProvincePathfinder(Map const& new_map, ThreadPool& new_thread_pool)
+	: map { new_map }, thread_pool { new_thread_pool }, generated { false }, wrap_width { 0.0f } {}
+
+cost_t ProvincePathfinder::_get_straight_distance(size_t from_node, size_t to_node) const {
+	node_position_t const& from = node_positions[from_node];
+	node_position_t const& to = node_positions[to_node];
+	float dx = std::abs(to.x - from.x);
+	if (wrap_width > 0.0f) {
+		dx = std::min(dx, wrap_width - dx);
+	}
+	const float dy = to.y - from.y;
+	return std::sqrt(dx * dx + dy * dy);
+}
+
+cost_t ProvincePathfinder::_get_heuristic(size_t node, size_t goal_node, cost_t const* goal_landmark_distances) const {
+	cost_t heuristic = _get_straight_distance(node, goal_node);
+	if (goal_landmark_distances != nullptr) {
+		/* By the triangle inequality, the difference between two provinces' distances from a landmark is a lower bound
+		 * on the distance between them. */
+		cost_t const* node_landmark_distances = landmark_distances.data() + node * landmarks.size();
+		for (size_t landmark = 0; landmark < landmarks.size(); ++landmark) {
+			const cost_t node_distance = node_landmark_distances[landmark];
+			const cost_t goal_distance = goal_landmark_distances[landmark];
+			if (std::isinf(node_distance) != std::isinf(goal_distance)) {
+				/* Exactly one of them is connected to the landmark, so they cannot be connected to each other. */
+				return INFINITE_COST;
+			}
+			if (!std::isinf(node_distance)) {
+				heuristic = std::max(heuristic, std::abs(goal_distance - node_distance));
+			}
+		}
+	}
+	return heuristic;
+}
+
+namespace {
+	struct heap_entry_t {
+		cost_t priority;
+		uint32_t node;
+
+		/* Inverted so the standard heap functions produce a min-heap. */
+		bool operator<(heap_entry_t const& other) const {
+			return priority > other.priority;
+		}
+	};
+}
+
+void ProvincePathfinder::_find_all_distances(size_t source_node, std::vector<cost_t>& distances) const {
+	std::vector<Province::adjacency_t> const& adjacencies = map.get_adjacencies();
+	std::vector<uint32_t> const& offsets = map.get_adjacency_offsets();
+
+	distances.assign(node_positions.size(), INFINITE_COST);
+	std::vector<heap_entry_t> heap;
+	distances[source_node] = 0;
+	heap.push_back({ 0, static_cast<uint32_t>(source_node) });
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end());
+		const heap_entry_t entry = heap.back();
+		heap.pop_back();
+		if (entry.priority > distances[entry.node]) {
+			continue;
+		}
+		for (size_t edge = entry.node > 0 ? offsets[entry.node - 1] : 0; edge < offsets[entry.node]; ++edge) {
+			const size_t neighbour = adjacencies[edge].get_to() - 1;
+			const cost_t distance = entry.priority + edge_costs[edge];
+			if (distance < distances[neighbour]) {
+				distances[neighbour] = distance;
+				heap.push_back({ distance, static_cast<uint32_t>(neighbour) });
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	}
+}
+
+bool ProvincePathfinder::generate(size_t landmark_count) {
+	OV_PROFILE_SCOPE("ProvincePathfinder::generate");
+	generated = false;
+	if (!map.provinces_are_locked()) {
+		Logger::error("Cannot generate pathfinding data until provinces are locked!");
+		return false;
+	}
+	const size_t node_count = map.get_province_count();
+	std::vector<Province::adjacency_t> const& adjacencies = map.get_adjacencies();
+	std::vector<uint32_t> const& offsets = map.get_adjacency_offsets();
+	if (offsets.size() != node_count) {
+		Logger::error("Cannot generate pathfinding data until province adjacencies are generated!");
+		return false;
+	}
+
+	node_positions.resize(node_count);
+	for (size_t node = 0; node < node_count; ++node) {
+		Province const& province = map.get_provinces()[node];
+		/* Provinces without a unit position from positions.txt fall back on their centroid in the shape image. */
+		fvec2_t position = province.get_positions().unit;
+		if (position.x == 0 && position.y == 0 && province.get_on_map()) {
+			position = province.get_shape_geometry().centroid;
+		}
+		node_positions[node] = { position.x.to_float(), position.y.to_float() };
+	}
+	wrap_width = static_cast<float>(map.get_width());
+
+	edge_costs.resize(adjacencies.size());
+	thread_pool.parallel_for(node_count, 256, [this, &adjacencies, &offsets](size_t begin, size_t end) -> void {
+		for (size_t node = begin; node < end; ++node) {
+			for (size_t edge = node > 0 ? offsets[node - 1] : 0; edge < offsets[node]; ++edge) {
+				Province::adjacency_t const& adjacency = adjacencies[edge];
+				const size_t neighbour = adjacency.get_to() - 1;
+				cost_t cost;
+				if (adjacency.get_through() != Province::NULL_INDEX) {
+					const size_t through = adjacency.get_through() - 1;
+					cost = _get_straight_distance(node, through) + _get_straight_distance(through, neighbour);
+				} else {
+					cost = _get_straight_distance(node, neighbour);
+				}
+				edge_costs[edge] = std::max(cost, MIN_EDGE_COST);
+			}
+		}
+	});
+
+	/* Landmarks are chosen by farthest point selection, each one being the province furthest from all those already
+	 * chosen, starting from the province furthest from the best connected one. */
+	landmarks.clear();
+	std::vector<std::vector<cost_t>> landmark_columns;
+	if (landmark_count > 0 && node_count > 0) {
+		const auto get_degree = [&offsets](size_t node) -> size_t {
+			return offsets[node] - (node > 0 ? offsets[node - 1] : 0);
+		};
+		size_t best_connected = 0;
+		for (size_t node = 1; node < node_count; ++node) {
+			if (get_degree(node) > get_degree(best_connected)) {
+				best_connected = node;
+			}
+		}
+		std::vector<cost_t> min_distances;
+		_find_all_distances(best_connected, min_distances);
+		while (landmarks.size() < landmark_count) {
+			size_t farthest = node_count;
+			for (size_t node = 0; node < node_count; ++node) {
+				if (!std::isinf(min_distances[node]) && min_distances[node] > 0 &&
+					(farthest == node_count || min_distances[node] > min_distances[farthest])) {
+					farthest = node;
+				}
+			}
+			if (farthest == node_count) {
+				break;
+			}
+			landmarks.push_back(farthest + 1);
+			_find_all_distances(farthest, landmark_columns.emplace_back());
+			std::vector<cost_t> const& distances = landmark_columns.back();
+			for (size_t node = 0; node < node_count; ++node) {
+				min_distances[node] = std::min(min_distances[node], distances[node]);
+			}
+		}
+	}
+	landmark_distances.resize(node_count * landmarks.size());
+	for (size_t node = 0; node < node_count; ++node) {
+		for (size_t landmark = 0; landmark < landmarks.size(); ++landmark) {
+			landmark_distances[node * landmarks.size() + landmark] = landmark_columns[landmark][node];
+		}
+	}
+
+	Logger::info(
+		"Generated pathfinding data for ", node_count, " provinces and ", adjacencies.size(), " adjacencies with ",
+		landmarks.size(), " landmarks"
+	);
+	generated = true;
+	return true;
+}
+
+namespace {
+	/* Per-thread search state, reused between queries. Entries are only valid where their stamp matches the current
+	 * query's, so nothing has to be cleared between queries. */
+	struct search_scratch_t {
+		std::vector<uint32_t> seen_stamps, closed_stamps;
+		std::vector<cost_t> costs;
+		std::vector<uint32_t> parents;
+		std::vector<heap_entry_t> heap;
+		uint32_t stamp = 0;
+
+		void prepare(size_t node_count) {
+			if (seen_stamps.size() != node_count || ++stamp == 0) {
+				seen_stamps.assign(node_count, 0);
+				closed_stamps.assign(node_count, 0);
+				costs.resize(node_count);
+				parents.resize(node_count);
+				stamp = 1;
+			}
+			heap.clear();
+		}
+	};
+}
+
+bool ProvincePathfinder::find_path(Province const& start, Province const& goal, filter_t const& filter, path_t& path) const {
+	path.provinces.clear();
+	path.cost = 0;
+	if (!generated) {
+		Logger::error("Cannot find paths until pathfinding data is generated!");
+		return false;
+	}
+	const size_t start_node = start.get_index() - 1, goal_node = goal.get_index() - 1;
+	if (start_node == goal_node) {
+		path.provinces.push_back(start.get_index());
+		return true;
+	}
+
+	std::vector<Province> const& provinces = map.get_provinces();
+	std::vector<Province::adjacency_t> const& adjacencies = map.get_adjacencies();
+	std::vector<uint32_t> const& offsets = map.get_adjacency_offsets();
+	cost_t const* goal_landmark_distances =
+		!landmarks.empty() ? landmark_distances.data() + goal_node * landmarks.size() : nullptr;
+
+	const cost_t start_heuristic = _get_heuristic(start_node, goal_node, goal_landmark_distances);
+	if (std::isinf(start_heuristic)) {
+		return false;
+	}
+
+	static thread_local search_scratch_t scratch;
+	scratch.prepare(provinces.size());
+	const uint32_t stamp = scratch.stamp;
+
+	scratch.seen_stamps[start_node] = stamp;
+	scratch.costs[start_node] = 0;
+	scratch.heap.push_back({ start_heuristic, static_cast<uint32_t>(start_node) });
+	while (!scratch.heap.empty()) {
+		std::pop_heap(scratch.heap.begin(), scratch.heap.end());
+		const uint32_t node = scratch.heap.back().node;
+		scratch.heap.pop_back();
+		if (scratch.closed_stamps[node] == stamp) {
+			continue;
+		}
+		scratch.closed_stamps[node] = stamp;
+
+		if (node == goal_node) {
+			path.cost = scratch.costs[goal_node];
+			for (size_t step = goal_node; step != start_node; step = scratch.parents[step]) {
+				path.provinces.push_back(step + 1);
+			}
+			path.provinces.push_back(start_node + 1);
+			std::reverse(path.provinces.begin(), path.provinces.end());
+			return true;
+		}
+
+		for (size_t edge = node > 0 ? offsets[node - 1] : 0; edge < offsets[node]; ++edge) {
+			Province::adjacency_t const& adjacency = adjacencies[edge];
+			const size_t neighbour = adjacency.get_to() - 1;
+			if (scratch.closed_stamps[neighbour] == stamp) {
+				continue;
+			}
+			const cost_t cost = scratch.costs[node] + edge_costs[edge];
+			if (scratch.seen_stamps[neighbour] == stamp && cost >= scratch.costs[neighbour]) {
+				continue;
+			}
+			Province const* through =
+				adjacency.get_through() != Province::NULL_INDEX ? &provinces[adjacency.get_through() - 1] : nullptr;
+			if (!filter.can_use(adjacency, provinces[neighbour], through, neighbour == goal_node)) {
+				continue;
+			}
+			const cost_t heuristic = _get_heuristic(neighbour, goal_node, goal_landmark_distances);
+			if (std::isinf(heuristic)) {
+				continue;
+			}
+			scratch.seen_stamps[neighbour] = stamp;
+			scratch.costs[neighbour] = cost;
+			scratch.parents[neighbour] = node;
+			scratch.heap.push_back({ cost + heuristic, static_cast<uint32_t>(neighbour) });
+			std::push_heap(scratch.heap.begin(), scratch.heap.end());
+		}
+	}
+	return false;
+}
+
+void ProvincePathfinder::find_paths(
+	std::span<const query_t> queries, filter_t const& filter, std::vector<path_t>& paths
+) const {
+	OV_PROFILE_SCOPE("ProvincePathfinder::find_paths");
+	paths.resize(queries.size());
+	if (!generated) {
+		Logger::error("Cannot find paths until pathfinding data is generated!");
+		for (path_t& path : paths) {
+			path.provinces.clear();
+			path.cost = 0;
+		}
+		return;
+	}
+	thread_pool.parallel_for(
+		queries.size(), QUERY_CHUNK_SIZE, [this, &queries, &filter, &paths](size_t begin, size_t end) -> void {
+			for (size_t idx = begin; idx < end; ++idx) {
+				Province const* start = map.get_province_by_index(queries[idx].start);
+				Province const* goal = map.get_province_by_index(queries[idx].goal);
+				if (start != nullptr && goal != nullptr) {
+					find_path(*start, *goal, filter, paths[idx]);
+				} else {
+					paths[idx].provinces.clear();
+					paths[idx].cost = 0;
+				}
+			}
+		}
+	);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "openvic-simulation/map/Province.hpp"
+#include "openvic-simulation/utility/ThreadPool.hpp"
+
+namespace OpenVic {
+	struct Map;
+
+	/* Shortest path queries over the map's province adjacency graph, using A* with a heuristic combining straight line
+	 * distance and optional precomputed landmark distances (ALT). Edge costs are the distances between province positions,
+	 * going via the crossed province for straits and canals.
+	 *
+	 * Once generated the search data is immutable, so any number of queries may run concurrently from different threads,
+	 * each using its own thread-local scratch space. Queries must not overlap with generate. */
+	struct ProvincePathfinder {
+		using cost_t = float;
+
+		static constexpr size_t DEFAULT_LANDMARK_COUNT = 8;
+
+		/* Decides which adjacencies a query may use. */
+		struct filter_t {
+			enum struct movement_t : uint8_t { LAND, NAVAL };
+
+			/* Land paths only enter land provinces. Naval paths only enter water provinces, except for the goal, so they
+			 * can end in a port. */
+			movement_t movement = movement_t::LAND;
+			/* Whether land paths may cross straits, i.e. SEA adjacencies between land provinces. */
+			bool allow_straits = true;
+			/* Whether naval paths may pass through canals, i.e. CANAL adjacencies between water provinces. */
+			bool allow_canals = true;
+			/* Optional check run on each province a path would enter, other than its start, and on the land province a
+			 * canal passes through. Used for e.g. military access. Must be safe to call from any thread. */
+			std::function<bool(Province const&)> can_enter;
+			/* Optional check run on the water province a strait crosses, e.g. to block crossings under enemy blockade.
+			 * Must be safe to call from any thread. */
+			std::function<bool(Province const&)> can_cross_strait;
+
+			bool can_use(
+				Province::adjacency_t const& adjacency, Province const& to, Province const* through, bool is_goal
+			) const;
+		};
+
+		struct path_t {
+			/* Province indices from the start to the goal inclusive, or empty if there is no path. */
+			std::vector<Province::index_t> provinces;
+			cost_t cost = 0;
+		};
+
+		struct query_t {
+			Province::index_t start, goal;
+		};
+
+	private:
+		struct node_position_t {
+			float x, y;
+		};
+
+		Map const& map;
+		ThreadPool& thread_pool;
+
+		bool PROPERTY(generated);
+		/* Indexed by province index - 1. */
+		std::vector<node_position_t> node_positions;
+		/* Parallel to the map's adjacency graph. */
+		std::vector<cost_t> edge_costs;
+		/* Horizontal distance at which the map wraps around, or 0 for no wrapping. */
+		float wrap_width;
+		std::vector<Province::index_t> PROPERTY(landmarks);
+		/* Distance from each landmark to each province, stored per province (index - 1) with one entry per landmark.
+		 * Unreachable provinces have infinite distance. */
+		std::vector<cost_t> landmark_distances;
+
+		cost_t _get_straight_distance(size_t from_node, size_t to_node) const;
+		cost_t _get_heuristic(size_t node, size_t goal_node, cost_t const* goal_landmark_distances) const;
+		/* Fills distances (indexed by province index - 1) with the cost of reaching each province from source using every
+		 * adjacency, as landmark distances must never exceed the cost of any filtered path. */
+		void _find_all_distances(size_t source_node, std::vector<cost_t>& distances) const;
+
+	public:
+		ProvincePathfinder(Map const& new_map, ThreadPool& new_thread_pool);
+
+		/* Builds the search data from the map's province positions and adjacency graph, which must already be loaded.
+		 * Landmarks speed up long queries in exchange for landmark_count floats of memory per province. */
+		bool generate(size_t landmark_count = DEFAULT_LANDMARK_COUNT);
+
+		/* Returns false and leaves path empty if there is no path from start to goal allowed by filter. */
+		bool find_path(Province const& start, Province const& goal, filter_t const& filter, path_t& path) const;
+		/* Runs every query on the thread pool, writing results to the corresponding entries of paths. */
+		void find_paths(std::span<const query_t> queries, filter_t const& filter, std::vector<path_t>& paths) const;
+	};
+}
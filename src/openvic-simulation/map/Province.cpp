@@ -1,16 +1,18 @@
 #include "Province.hpp"
 
 #include "openvic-simulation/history/ProvinceHistory.hpp"
+#include "openvic-simulation/map/Map.hpp"
+#include "openvic-simulation/utility/Profiler.hpp"
 
 using namespace OpenVic;
 using namespace OpenVic::NodeTools;
 
 Province::Province(
-	std::string_view new_identifier, colour_t new_colour, index_t new_index
-) : HasIdentifierAndColour { new_identifier, new_colour, true, false }, index { new_index },
+	std::string_view new_identifier, colour_t new_colour, index_t new_index, Map& new_map
+) : HasIdentifierAndColour { new_identifier, new_colour, true, false }, map { new_map }, index { new_index },
 	region { nullptr }, on_map { false }, has_region { false }, water { false }, default_terrain_type { nullptr },
-	terrain_type { nullptr }, life_rating { 0 }, colony_status { colony_status_t::STATE }, owner { nullptr },
-	controller { nullptr }, slave { false }, buildings { "buildings", false }, rgo { nullptr }, total_population { 0 } {
+	shape_geometry {}, terrain_type { nullptr }, colony_status { colony_status_t::STATE }, slave { false },
+	buildings { "buildings", false } {
 	assert(index != NULL_INDEX);
 }
 
@@ -20,6 +22,30 @@ std::string Province::to_string() const {
 	return stream.str();
 }
 
+Province::life_rating_t Province::get_life_rating() const {
+	return map.get_province_state().get_life_rating(index);
+}
+
+Country const* Province::get_owner() const {
+	return map.get_province_state().get_owner(index);
+}
+
+Country const* Province::get_controller() const {
+	return map.get_province_state().get_controller(index);
+}
+
+Good const* Province::get_rgo() const {
+	return map.get_province_state().get_rgo(index);
+}
+
+Pop::pop_size_t Province::get_total_population() const {
+	return map.get_province_state().get_total_population(index);
+}
+
+void Province::mark_dirty() {
+	map.mark_province_dirty(index);
+}
+
 bool Province::load_positions(BuildingManager const& building_manager, ast::NodeCPtr root) {
 	return expect_dictionary_keys(
 		"text_position", ZERO_OR_ONE, expect_fvec2(assign_variable_callback(positions.text)),
@@ -49,16 +75,20 @@ bool Province::load_positions(BuildingManager const& building_manager, ast::Node
 	)(root);
 }
 
-bool Province::expand_building(std::string_view building_type_identifier) {
+bool Province::expand_building(std::string_view building_type_identifier, Date today) {
 	BuildingInstance* building = buildings.get_item_by_identifier(building_type_identifier);
 	if (building == nullptr) {
 		return false;
 	}
-	return building->expand();
+	if (!building->expand(today)) {
+		return false;
+	}
+	mark_dirty();
+	return true;
 }
 
 bool Province::load_pop_list(PopManager const& pop_manager, ast::NodeCPtr root) {
-	return expect_dictionary_reserve_length(pops,
+	return expect_dictionary(
 		[this, &pop_manager](std::string_view pop_type_identifier, ast::NodeCPtr pop_node) -> bool {
 			return pop_manager.load_pop_into_province(*this, pop_type_identifier, pop_node);
 		}
@@ -67,7 +97,10 @@ bool Province::load_pop_list(PopManager const& pop_manager, ast::NodeCPtr root)
 
 bool Province::add_pop(Pop&& pop) {
 	if (!get_water()) {
-		pops.push_back(std::move(pop));
+		if (map.get_pop_store().add_pop(index, pop) == PopStore::NULL_HANDLE) {
+			return false;
+		}
+		mark_dirty();
 		return true;
 	} else {
 		Logger::error("Trying to add pop to water province ", get_identifier());
@@ -76,113 +109,115 @@ bool Province::add_pop(Pop&& pop) {
 }
 
 size_t Province::get_pop_count() const {
-	return pops.size();
+	return get_pop_range().count;
+}
+
+PopStore::province_range_t Province::get_pop_range() const {
+	return map.get_pop_store().get_province_range(index);
+}
+
+std::vector<Pop> Province::get_pops() const {
+	PopStore const& store = map.get_pop_store();
+	const PopStore::province_range_t range = get_pop_range();
+	std::vector<Pop> ret;
+	ret.reserve(range.count);
+	for (size_t row = range.begin; row < range.begin + range.count; ++row) {
+		ret.push_back(store.get_pop(row));
+	}
+	return ret;
 }
 
 /* REQUIREMENTS:
  * MAP-65, MAP-68, MAP-70, MAP-234
  */
 void Province::update_pops() {
-	total_population = 0;
-	pop_type_distribution.clear();
-	ideology_distribution.clear();
-	culture_distribution.clear();
-	religion_distribution.clear();
-	for (Pop const& pop : pops) {
-		total_population += pop.get_size();
-		pop_type_distribution[&pop.get_type()] += pop.get_size();
-		//ideology_distribution[&pop.get_???()] += pop.get_size();
-		culture_distribution[&pop.get_culture()] += pop.get_size();
-		religion_distribution[&pop.get_religion()] += pop.get_size();
+	OV_PROFILE_SCOPE("Province::update_pops");
+	Pop::pop_size_t total_population = 0;
+	PopStore const& store = map.get_pop_store();
+	if (store.get_pop_manager() != nullptr) {
+		PopManager const& pop_manager = *store.get_pop_manager();
+		pop_type_distribution.reset(pop_manager.get_pop_types());
+		culture_distribution.reset(pop_manager.get_culture_manager().get_cultures());
+		religion_distribution.reset(pop_manager.get_religion_manager().get_religions());
 	}
+	ideology_distribution.reset({});
+	/* The store's index columns index the distributions directly, so this loop is plain array arithmetic. */
+	std::span<const Pop::pop_size_t> sizes = store.get_sizes();
+	std::span<const PopStore::type_index_t> types = store.get_types();
+	std::span<const PopStore::culture_index_t> cultures = store.get_cultures();
+	std::span<const PopStore::religion_index_t> religions = store.get_religions();
+	const PopStore::province_range_t range = get_pop_range();
+	for (size_t row = range.begin; row < range.begin + range.count; ++row) {
+		const Pop::pop_size_t size = sizes[row];
+		total_population += size;
+		pop_type_distribution[types[row]] += size;
+		//ideology_distribution[???[row]] += size;
+		culture_distribution[cultures[row]] += size;
+		religion_distribution[religions[row]] += size;
+	}
+	map.get_province_state().total_populations[index] = total_population;
 }
 
 void Province::update_state(Date today) {
+	ModifierEffect const* population_growth_effect = map.get_population_growth_effect();
+	fixed_point_t population_growth_modifier = 0;
+	if (population_growth_effect != nullptr && terrain_type != nullptr) {
+		population_growth_modifier += terrain_type->get_modifier().get_effect(population_growth_effect);
+	}
 	for (BuildingInstance& building : buildings.get_items()) {
 		building.update_state(today);
+		if (population_growth_effect != nullptr) {
+			population_growth_modifier += building.get_building_type().get_modifier().get_effect(population_growth_effect) *
+				static_cast<int32_t>(building.get_level());
+		}
 	}
+	map.get_province_state().set_population_growth_modifier(index, population_growth_modifier);
 	update_pops();
 }
 
-void Province::tick(Date today) {
-	for (BuildingInstance& building : buildings.get_items()) {
-		building.tick(today);
-	}
-}
-
-Province::adjacency_t::adjacency_t(Province const* province, distance_t distance, flags_t flags)
-	: province{ province }, distance{ distance }, flags{ flags }, type{ adjacency_t::type_t::standard} {
-	assert(province != nullptr);
-}
-
-Province::adjacency_t::adjacency_t(Province const* province, distance_t distance, flags_t flags, type_t type, Province const* through_province)
-	: province{ province }, distance{ distance }, flags{ flags }, type{ type }, through_province{ through_province } {
-	assert(province != nullptr);
+Province::adjacency_t::adjacency_t(
+	index_t new_to, index_t new_through, distance_t new_distance, flags_t new_flags, type_t new_type
+) : to { new_to }, through { new_through }, distance { new_distance }, flags { new_flags }, type { new_type } {
+	assert(to != NULL_INDEX);
 }
 
-bool Province::is_adjacent_to(Province const* province) {
-	for (adjacency_t adj : adjacencies) {
-		if (adj.province == province) {
-			return true;
-		}
+bool Province::adjacency_t::get_type_from_string(std::string_view type_string, type_t& type) {
+	using enum type_t;
+	static const string_map_t<type_t> type_map {
+		{ "", STANDARD }, { "land", STANDARD }, { "sea", SEA }, { "impassable", IMPASSABLE }, { "canal", CANAL }
+	};
+	const string_map_t<type_t>::const_iterator it = type_map.find(type_string);
+	if (it != type_map.end()) {
+		type = it->second;
+		return true;
 	}
+	Logger::error("Invalid province adjacency type: \"", type_string, "\"");
 	return false;
 }
 
-bool Province::add_adjacency(Province const* province, distance_t distance, flags_t flags) {
-	if (province == nullptr) {
-		Logger::error("Tried to create null adjacency province for province ", get_identifier(), "!");
-		return false;
-	}
-	if (is_adjacent_to(province)) {
-		return false;
-	}
-	adjacencies.push_back({ province, distance, flags });
-	return true;
-}
-
-bool Province::add_special_adjacency(Province const* province, distance_t distance, flags_t flags, adjacency_t::type_t type, Province const* through)
-{
+Province::adjacency_t const* Province::get_adjacency_to(Province const* province) const {
 	if (province == nullptr) {
-		Logger::error("Tried to create null adjacency province for province ", get_identifier(), "!");
-		return false;
+		return nullptr;
 	}
-	if (is_adjacent_to(province)) {
-		return false;
-	}
-	adjacencies.push_back({ province, distance, flags, type, through });
-	return true;
+	const std::span<const adjacency_t>::iterator it = std::lower_bound(
+		adjacencies.begin(), adjacencies.end(), province->get_index(),
+		[](adjacency_t const& adjacency, index_t index) -> bool {
+			return adjacency.get_to() < index;
+		}
+	);
+	return it != adjacencies.end() && it->get_to() == province->get_index() ? &*it : nullptr;
 }
 
-adjacency_t::type_t OpenVic::Province::get_adjacency_type_from_string(std::String type)
-{
-	switch (type)
-	{
-		case "sea":
-			return adjacency_t::type_t::sea
-				break;
-		case "impassable":
-			return adjacency_t::type_t::impassable
-				break;
-		case "canal":
-			return adjacency_t::type_t::canal
-				break;
-		default:
-			return adjacency_t::type_t::standard
-				break;
-	}
-	return adjacency_t::type_t::standard
+bool Province::is_adjacent_to(Province const* province) const {
+	return get_adjacency_to(province) != nullptr;
 }
 
 bool Province::reset(BuildingManager const& building_manager) {
 	terrain_type = default_terrain_type;
-	life_rating = 0;
 	colony_status = colony_status_t::STATE;
-	owner = nullptr;
-	controller = nullptr;
 	cores.clear();
 	slave = false;
-	rgo = nullptr;
+	map.get_province_state().reset_province(index);
 
 	buildings.reset();
 	bool ret = true;
@@ -200,8 +235,9 @@ bool Province::reset(BuildingManager const& building_manager) {
 	}
 	lock_buildings();
 
-	pops.clear();
+	map.get_pop_store().clear_province(index);
 	update_pops();
+	mark_dirty();
 
 	return ret;
 }
@@ -211,12 +247,14 @@ bool Province::apply_history_to_province(ProvinceHistoryEntry const* entry) {
 		Logger::error("Trying to apply null province history to ", get_identifier());
 		return false;
 	}
-	if (entry->get_life_rating()) life_rating = *entry->get_life_rating();
+	mark_dirty();
+	ProvinceState& state = map.get_province_state();
+	if (entry->get_life_rating()) state.life_ratings[index] = *entry->get_life_rating();
 	if (entry->get_colonial()) colony_status = *entry->get_colonial();
-	if (entry->get_rgo()) rgo = *entry->get_rgo();
+	if (entry->get_rgo()) state.rgos[index] = *entry->get_rgo();
 	if (entry->get_terrain_type()) terrain_type = *entry->get_terrain_type();
-	if (entry->get_owner()) owner = *entry->get_owner();
-	if (entry->get_controller()) controller = *entry->get_controller();
+	if (entry->get_owner()) state.owners[index] = *entry->get_owner();
+	if (entry->get_controller()) state.controllers[index] = *entry->get_controller();
 	if (entry->get_slave()) slave = *entry->get_slave();
 	for (Country const* core : entry->get_remove_cores()) {
 		const typename decltype(cores)::iterator existing_core = std::find(cores.begin(), cores.end(), core);
@@ -255,3 +293,91 @@ bool Province::apply_history_to_province(ProvinceHistoryEntry const* entry) {
 	// TODO: party loyalties for each POP when implemented on POP side#
 	return ret;
 }
+
+void Province::save_snapshot(
+	BinaryWriter& writer, CountryManager const& country_manager, GoodManager const& good_manager,
+	PopManager const& pop_manager
+) const {
+	writer.write_index(map.get_terrain_type_manager().get_terrain_types(), terrain_type);
+	ProvinceState const& state = map.get_province_state();
+	writer.write(state.get_life_rating(index));
+	writer.write(colony_status);
+	writer.write_index(country_manager.get_countries(), state.get_owner(index));
+	writer.write_index(country_manager.get_countries(), state.get_controller(index));
+	writer.write<uint32_t>(cores.size());
+	for (Country const* core : cores) {
+		writer.write_index(country_manager.get_countries(), core);
+	}
+	writer.write(slave);
+	writer.write_index(good_manager.get_goods(), state.get_rgo(index));
+	writer.write<uint32_t>(buildings.size());
+	for (BuildingInstance const& building : buildings.get_items()) {
+		building.save_snapshot(writer);
+	}
+	PopStore const& store = map.get_pop_store();
+	const PopStore::province_range_t range = get_pop_range();
+	writer.write<uint32_t>(range.count);
+	for (size_t row = range.begin; row < range.begin + range.count; ++row) {
+		pop_manager.save_pop_snapshot(writer, store.get_pop(row));
+	}
+}
+
+bool Province::load_snapshot(
+	BinaryReader& reader, CountryManager const& country_manager, GoodManager const& good_manager,
+	PopManager const& pop_manager
+) {
+	mark_dirty();
+	ProvinceState& state = map.get_province_state();
+	uint32_t core_count;
+	if (!(
+		reader.read_index(map.get_terrain_type_manager().get_terrain_types(), terrain_type) &&
+		reader.read(state.life_ratings[index]) && reader.read_enum(colony_status, colony_status_t::COLONY) &&
+		reader.read_index(country_manager.get_countries(), state.owners[index]) &&
+		reader.read_index(country_manager.get_countries(), state.controllers[index]) && reader.read(core_count)
+	)) {
+		return false;
+	}
+	/* Checked before resizing, so a corrupt count can't ask for more cores than the data could possibly hold. */
+	if (core_count > reader.get_remaining() / sizeof(BinaryReader::index_t)) {
+		Logger::error("Snapshot has invalid core count ", core_count, " for province ", get_identifier());
+		return false;
+	}
+	cores.resize(core_count);
+	for (Country const*& core : cores) {
+		if (!reader.read_non_null_index(country_manager.get_countries(), core)) {
+			return false;
+		}
+	}
+	uint32_t building_count;
+	if (!(
+		reader.read_bool(slave) && reader.read_index(good_manager.get_goods(), state.rgos[index]) && reader.read(building_count)
+	)) {
+		return false;
+	}
+	if (building_count != buildings.size()) {
+		Logger::error(
+			"Snapshot has ", building_count, " buildings for province ", get_identifier(), ", expected ", buildings.size()
+		);
+		return false;
+	}
+	for (BuildingInstance& building : buildings.get_items()) {
+		if (!building.load_snapshot(reader)) {
+			return false;
+		}
+	}
+	uint32_t pop_count;
+	if (!reader.read(pop_count)) {
+		return false;
+	}
+	if (pop_count > reader.get_remaining() / PopManager::POP_SNAPSHOT_SIZE) {
+		Logger::error("Snapshot has invalid pop count ", pop_count, " for province ", get_identifier());
+		return false;
+	}
+	map.get_pop_store().clear_province(index);
+	for (uint32_t pop_index = 0; pop_index < pop_count; ++pop_index) {
+		if (!pop_manager.load_pop_snapshot_into_province(reader, *this)) {
+			return false;
+		}
+	}
+	return true;
+}
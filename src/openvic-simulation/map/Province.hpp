@@ -1,10 +1,12 @@
 #pragma once
 
 #include <cassert>
+#include <span>
 
 #include "openvic-simulation/economy/BuildingInstance.hpp"
 #include "openvic-simulation/politics/Ideology.hpp"
 #include "openvic-simulation/pop/Pop.hpp"
+#include "openvic-simulation/pop/PopStore.hpp"
 #include "openvic-simulation/country/Country.hpp"
 
 namespace OpenVic {
@@ -29,20 +31,28 @@ namespace OpenVic {
 
 		enum struct colony_status_t : int8_t { STATE, PROTECTORATE, COLONY };
 
+		/* An entry in the map's province adjacency graph, describing a connection to the province with index to.
+		 * Adjacencies come from provinces touching in the shape image, with their types, crossing provinces and data
+		 * set or overridden by the map's adjacencies file. */
 		struct adjacency_t {
-			friend struct Province;
-			enum type_t {standard, sea, impassable, canal};
+			friend struct Map;
+
+			enum struct type_t : uint8_t { STANDARD, SEA, IMPASSABLE, CANAL };
 
 		private:
-			type_t PROPERTY(type);
-			Province const* const province;
-			const distance_t PROPERTY(distance);
-			Province const* const through_province;
+			index_t PROPERTY(to);
+			/* The province crossed to reach the destination, e.g. the water province of a strait or canal, or NULL_INDEX
+			 * if there is none. */
+			index_t PROPERTY(through);
+			distance_t PROPERTY(distance);
 			//For now using Flags as the "data" section of adjacencies.csv
 			flags_t PROPERTY(flags);
+			type_t PROPERTY(type);
 
-			adjacency_t(Province const* province, distance_t distance, flags_t flags);
-			adjacency_t(Province const* province, distance_t distance, flags_t flags, type_t type, Province const* through_province);
+			adjacency_t(index_t new_to, index_t new_through, distance_t new_distance, flags_t new_flags, type_t new_type);
+
+		public:
+			static bool get_type_from_string(std::string_view type_string, type_t& type);
 		};
 
 		struct province_positions_t {
@@ -62,9 +72,19 @@ namespace OpenVic {
 			fixed_point_t navalbase_rotation;
 		};
 
+		/* Where the province is in the shape image. The bounding box corners are inclusive pixel coordinates and the
+		 * centroid is the mean of the province's pixel centres, both ignoring the map's horizontal wrapping. Everything is
+		 * zero for provinces which are not on the map. */
+		struct shape_geometry_t {
+			uint32_t pixel_area;
+			ivec2_t bounds_min, bounds_max;
+			fvec2_t centroid;
+		};
+
 		static constexpr index_t NULL_INDEX = 0, MAX_INDEX = std::numeric_limits<index_t>::max();
 
 	private:
+		Map& map;
 		const index_t PROPERTY(index);
 		Region* PROPERTY(region);
 		bool PROPERTY(on_map);
@@ -72,54 +92,77 @@ namespace OpenVic {
 		bool PROPERTY(water);
 		/* Terrain type calculated from terrain image */
 		TerrainType const* PROPERTY(default_terrain_type);
+		/* Calculated from the shape image along with default_terrain_type */
+		shape_geometry_t PROPERTY(shape_geometry);
 
-		std::vector<adjacency_t> PROPERTY(adjacencies);
-		province_positions_t positions;
+		/* View of this province's row of the map's adjacency graph, sorted by destination index. */
+		std::span<const adjacency_t> PROPERTY(adjacencies);
+		province_positions_t PROPERTY(positions);
 
+		/* The life rating, owner, controller, RGO and total population are stored in the map's ProvinceState. */
 		TerrainType const* PROPERTY(terrain_type);
-		life_rating_t PROPERTY(life_rating);
 		colony_status_t PROPERTY(colony_status);
-		Country const* PROPERTY(owner);
-		Country const* PROPERTY(controller);
 		std::vector<Country const*> PROPERTY(cores);
 		bool PROPERTY(slave);
-		// TODO - change this into a factory-like structure
-		Good const* PROPERTY(rgo);
 		IdentifierRegistry<BuildingInstance> buildings;
 
-		std::vector<Pop> PROPERTY(pops);
-		Pop::pop_size_t PROPERTY(total_population);
-		fixed_point_map_t<PopType const*> PROPERTY(pop_type_distribution);
-		fixed_point_map_t<Ideology const*> PROPERTY(ideology_distribution);
-		fixed_point_map_t<Culture const*> PROPERTY(culture_distribution);
-		fixed_point_map_t<Religion const*> PROPERTY(religion_distribution);
+		/* Indexed by position in the pop manager's registries. */
+		IndexedFixedPointMap<PopType> PROPERTY(pop_type_distribution);
+		IndexedFixedPointMap<Ideology> PROPERTY(ideology_distribution);
+		IndexedFixedPointMap<Culture> PROPERTY(culture_distribution);
+		IndexedFixedPointMap<Religion> PROPERTY(religion_distribution);
 
-		Province(std::string_view new_identifier, colour_t new_colour, index_t new_index);
+		Province(std::string_view new_identifier, colour_t new_colour, index_t new_index, Map& new_map);
 
 	public:
 		Province(Province&&) = default;
 
 		std::string to_string() const;
 
+		/* Read from the map's ProvinceState. Code going over many provinces should read its columns directly. */
+		life_rating_t get_life_rating() const;
+		Country const* get_owner() const;
+		Country const* get_controller() const;
+		// TODO - change this into a factory-like structure
+		Good const* get_rgo() const;
+		Pop::pop_size_t get_total_population() const;
+
+		/* Flags this province for recalculation on the map's next state update. Anything that changes the province's
+		 * buildings, pops or history-derived values must call this. Safe to call from thread pool workers. */
+		void mark_dirty();
+
 		bool load_positions(BuildingManager const& building_manager, ast::NodeCPtr root);
 
 		IDENTIFIER_REGISTRY_ACCESSORS(building)
-		bool expand_building(std::string_view building_type_identifier);
+		IDENTIFIER_REGISTRY_NON_CONST_ACCESSORS(building)
+		bool expand_building(std::string_view building_type_identifier, Date today);
 
+		/* Pops are stored in the map's PopStore, as the rows of this range. */
+		PopStore::province_range_t get_pop_range() const;
+		/* Rebuilds the province's pops from the PopStore, for code wanting them as objects. */
+		std::vector<Pop> get_pops() const;
 		bool load_pop_list(PopManager const& pop_manager, ast::NodeCPtr root);
 		bool add_pop(Pop&& pop);
 		size_t get_pop_count() const;
 		void update_pops();
 
 		void update_state(Date today);
-		void tick(Date today);
 
-		bool is_adjacent_to(Province const* province);
-		bool add_adjacency(Province const* province, distance_t distance, flags_t flags);
-		bool add_special_adjacency(Province const* province, distance_t distance, flags_t flags, adjacency_t::type_t type, Province const* through);
-		adjacency_t::type_t get_adjacency_type_from_string(std::String type);
+		bool is_adjacent_to(Province const* province) const;
+		adjacency_t const* get_adjacency_to(Province const* province) const;
 
 		bool reset(BuildingManager const& building_manager);
 		bool apply_history_to_province(ProvinceHistoryEntry const* entry);
+
+		/* Snapshots cover the province's mutable state: history-derived values, buildings and pops. Values derived from
+		 * these, such as the pop distributions, are recalculated by the next state update rather than stored. */
+		void save_snapshot(
+			BinaryWriter& writer, CountryManager const& country_manager, GoodManager const& good_manager,
+			PopManager const& pop_manager
+		) const;
+		bool load_snapshot(
+			BinaryReader& reader, CountryManager const& country_manager, GoodManager const& good_manager,
+			PopManager const& pop_manager
+		);
 	};
 }
@@ -0,0 +1,185 @@
+#include "ProvinceShapeImage.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+using namespace OpenVic;
+
+/* Number of points get_pixels_at works on at a time. */
+static constexpr size_t POINT_CHUNK_SIZE = 256;
+
+ProvinceShapeImage::ProvinceShapeImage() : storage { storage_t::RAW }, width { 0 }, height { 0 }, next_raw_row { 0 } {}
+
+void ProvinceShapeImage::reset(size_t new_width, size_t new_height, storage_t new_storage) {
+	clear();
+	storage = new_storage;
+	width = new_width;
+	height = new_height;
+	if (storage == storage_t::RAW) {
+		pixels.assign(width * height, { Province::NULL_INDEX, 0 });
+	} else {
+		row_offsets.reserve(height + 1);
+		row_offsets.push_back(0);
+	}
+}
+
+void ProvinceShapeImage::clear() {
+	width = 0;
+	height = 0;
+	pixels = {};
+	runs = {};
+	row_offsets = {};
+	next_raw_row = 0;
+}
+
+ProvinceShapeImage::pixel_t* ProvinceShapeImage::get_raw_row(size_t y) {
+	assert(storage == storage_t::RAW && y < height);
+	return pixels.data() + y * width;
+}
+
+void ProvinceShapeImage::encode_row(std::span<const pixel_t> row, std::vector<run_t>& runs) {
+	for (size_t x = 0; x < row.size();) {
+		const pixel_t pixel = row[x];
+		while (++x < row.size() && row[x] == pixel) {}
+		runs.push_back({ static_cast<uint32_t>(x), pixel });
+	}
+}
+
+void ProvinceShapeImage::append_row_runs(std::span<const run_t> row_runs) {
+	assert(storage == storage_t::RUNS && row_offsets.size() <= height);
+	assert(!row_runs.empty() ? row_runs.back().end == width : width == 0);
+	runs.insert(runs.end(), row_runs.begin(), row_runs.end());
+	_end_runs_row();
+}
+
+void ProvinceShapeImage::_end_runs_row() {
+	row_offsets.push_back(runs.size());
+	if (row_offsets.size() == height + 1) {
+		/* Runs are appended without knowing the final count, so trim the growth slack once the image is complete. */
+		runs.shrink_to_fit();
+	}
+}
+
+void ProvinceShapeImage::append_row(std::span<const pixel_t> row) {
+	assert(row.size() == width);
+	if (storage == storage_t::RAW) {
+		std::copy(row.begin(), row.end(), get_raw_row(next_raw_row++));
+	} else {
+		assert(row_offsets.size() <= height);
+		encode_row(row, runs);
+		_end_runs_row();
+	}
+}
+
+std::span<const ProvinceShapeImage::run_t> ProvinceShapeImage::_get_row_runs(size_t y) const {
+	return { runs.data() + row_offsets[y], runs.data() + row_offsets[y + 1] };
+}
+
+ProvinceShapeImage::pixel_t ProvinceShapeImage::get_pixel(size_t x, size_t y) const {
+	if (storage == storage_t::RAW) {
+		return pixels[x + y * width];
+	}
+	const std::span<const run_t> row_runs = _get_row_runs(y);
+	return std::upper_bound(
+		row_runs.begin(), row_runs.end(), x, [](size_t x, run_t const& run) -> bool {
+			return x < run.end;
+		}
+	)->pixel;
+}
+
+void ProvinceShapeImage::get_pixels_at(
+	std::span<const int32_t> xs, std::span<const int32_t> ys, Province::index_t* indices,
+	TerrainTypeMapping::index_t* terrains
+) const {
+	assert(xs.size() == ys.size());
+	static constexpr pixel_t null_pixel { Province::NULL_INDEX, 0 };
+	if (width == 0 || height == 0) {
+		std::fill_n(indices, xs.size(), null_pixel.index);
+		if (terrains != nullptr) {
+			std::fill_n(terrains, xs.size(), null_pixel.terrain);
+		}
+		return;
+	}
+
+	/* Each chunk is first bounds checked in a branch-free loop the compiler can vectorise, with points outside the
+	 * image redirected to (0, 0) so the lookups need no branches either, and then each point's pixel is fetched. */
+	std::array<uint32_t, POINT_CHUNK_SIZE> columns, rows;
+	std::array<uint8_t, POINT_CHUNK_SIZE> inside;
+	for (size_t chunk = 0; chunk < xs.size(); chunk += POINT_CHUNK_SIZE) {
+		const size_t count = std::min(POINT_CHUNK_SIZE, xs.size() - chunk);
+		for (size_t idx = 0; idx < count; ++idx) {
+			/* Negative coordinates become too large once unsigned, so one comparison per axis covers both ends. */
+			const uint32_t x = xs[chunk + idx], y = ys[chunk + idx];
+			const bool point_inside = x < width && y < height;
+			columns[idx] = point_inside ? x : 0;
+			rows[idx] = point_inside ? y : 0;
+			inside[idx] = point_inside;
+		}
+
+		for (size_t idx = 0; idx < count; ++idx) {
+			pixel_t pixel;
+			if (storage == storage_t::RAW) {
+				pixel = pixels[static_cast<size_t>(rows[idx]) * width + columns[idx]];
+			} else {
+				/* Branch-free binary search for the first run ending after the column. Every row has runs up to the
+				 * image's width, so there always is one. */
+				const std::span<const run_t> row_runs = _get_row_runs(rows[idx]);
+				run_t const* run = row_runs.data();
+				for (size_t remaining = row_runs.size(); remaining > 1;) {
+					const size_t half = remaining / 2;
+					run = run[half - 1].end <= columns[idx] ? run + half : run;
+					remaining -= half;
+				}
+				pixel = run->pixel;
+			}
+			if (!inside[idx]) {
+				pixel = null_pixel;
+			}
+			indices[chunk + idx] = pixel.index;
+			if (terrains != nullptr) {
+				terrains[chunk + idx] = pixel.terrain;
+			}
+		}
+	}
+}
+
+void ProvinceShapeImage::get_row(size_t y, pixel_t* target) const {
+	if (storage == storage_t::RAW) {
+		std::copy_n(pixels.data() + y * width, width, target);
+		return;
+	}
+	size_t x = 0;
+	for (run_t const& run : _get_row_runs(y)) {
+		target = std::fill_n(target, run.end - x, run.pixel);
+		x = run.end;
+	}
+}
+
+bool ProvinceShapeImage::get_region(size_t x, size_t y, size_t region_width, size_t region_height, pixel_t* target) const {
+	if (x > width || region_width > width - x || y > height || region_height > height - y) {
+		return false;
+	}
+	for (size_t row = y; row < y + region_height; ++row) {
+		if (storage == storage_t::RAW) {
+			target = std::copy_n(pixels.data() + row * width + x, region_width, target);
+			continue;
+		}
+		const std::span<const run_t> row_runs = _get_row_runs(row);
+		std::span<const run_t>::iterator run = std::upper_bound(
+			row_runs.begin(), row_runs.end(), x, [](size_t x, run_t const& run) -> bool {
+				return x < run.end;
+			}
+		);
+		for (size_t column = x; column < x + region_width; ++run) {
+			const size_t run_end = std::min<size_t>(run->end, x + region_width);
+			target = std::fill_n(target, run_end - column, run->pixel);
+			column = run_end;
+		}
+	}
+	return true;
+}
+
+size_t ProvinceShapeImage::get_memory_usage() const {
+	return pixels.capacity() * sizeof(pixel_t) + runs.capacity() * sizeof(run_t) + row_offsets.capacity() * sizeof(uint32_t);
+}
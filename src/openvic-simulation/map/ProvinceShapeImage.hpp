@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "openvic-simulation/map/Province.hpp"
+#include "openvic-simulation/map/TerrainType.hpp"
+
+namespace OpenVic {
+	/* The province index and terrain texture of every pixel of the map, stored either as a raw array of pixels or as
+	 * runs of identical pixels along each row. Provinces are large and terrain changes far less often than every pixel,
+	 * so runs take a fraction of the memory of the raw array, in exchange for point queries being a binary search of
+	 * the row's runs rather than a single lookup. Either way rows and rectangular regions can be expanded into raw
+	 * pixels on demand, e.g. to upload tiles to the renderer. */
+	struct ProvinceShapeImage {
+#pragma pack(push, 1)
+		/* Used to represent tightly packed 3-byte integer pixel information. */
+		struct pixel_t {
+			Province::index_t index;
+			TerrainTypeMapping::index_t terrain;
+
+			constexpr bool operator==(pixel_t const&) const = default;
+		};
+#pragma pack(pop)
+
+		enum struct storage_t : uint8_t { RAW, RUNS };
+
+		/* A run of identical pixels, ending before x = end and starting at the end of the previous run in the row. */
+		struct run_t {
+			uint32_t end;
+			pixel_t pixel;
+		};
+
+	private:
+		storage_t PROPERTY(storage);
+		size_t PROPERTY(width);
+		size_t PROPERTY(height);
+		/* Only used with RAW storage. */
+		std::vector<pixel_t> PROPERTY(pixels);
+		/* Only used with RUNS storage. Row y's runs are [row_offsets[y], row_offsets[y + 1]) */
+		std::vector<run_t> runs;
+		std::vector<uint32_t> row_offsets;
+		/* The row the next append_row call fills in a RAW image. */
+		size_t next_raw_row;
+
+		std::span<const run_t> _get_row_runs(size_t y) const;
+		void _end_runs_row();
+
+	public:
+		ProvinceShapeImage();
+
+		/* Clears the image and sets its dimensions. RAW images start filled with null pixels, to be written through
+		 * get_raw_row, while RUNS images start with no rows, to be added in order through append_row_runs. */
+		void reset(size_t new_width, size_t new_height, storage_t new_storage);
+		void clear();
+
+		/* Only valid for RAW images. */
+		pixel_t* get_raw_row(size_t y);
+		/* Appends the runs encoding a row of pixels to runs. */
+		static void encode_row(std::span<const pixel_t> row, std::vector<run_t>& runs);
+		/* Only valid for RUNS images, with rows added from y = 0 upwards. */
+		void append_row_runs(std::span<const run_t> row_runs);
+		/* Encodes and appends a row of pixels to a RUNS image, or copies it into the next row of a RAW image. */
+		void append_row(std::span<const pixel_t> row);
+
+		/* x and y must be within the image. */
+		pixel_t get_pixel(size_t x, size_t y) const;
+		/* Looks up the pixel at each point (xs[i], ys[i]), writing its province index to indices[i] and, unless terrains is
+		 * null, its terrain to terrains[i]. Points outside the image get NULL_INDEX and terrain 0. xs and ys must be the
+		 * same length, with the targets at least as long. */
+		void get_pixels_at(
+			std::span<const int32_t> xs, std::span<const int32_t> ys, Province::index_t* indices,
+			TerrainTypeMapping::index_t* terrains
+		) const;
+		/* Writes the width pixels of row y to target. */
+		void get_row(size_t y, pixel_t* target) const;
+		/* Writes the region_width by region_height pixels starting at (x, y) to target, one row after another. Returns
+		 * false without writing anything if the region is not entirely within the image. */
+		bool get_region(size_t x, size_t y, size_t region_width, size_t region_height, pixel_t* target) const;
+
+		/* Approximate bytes used for the image data. */
+		size_t get_memory_usage() const;
+	};
+}
@@ -0,0 +1,33 @@
+#include "ProvinceState.hpp"
+
+using namespace OpenVic;
+
+ProvinceState::ProvinceState() {
+	add_province();
+}
+
+void ProvinceState::add_province() {
+	owners.push_back(nullptr);
+	controllers.push_back(nullptr);
+	total_populations.push_back(0);
+	rgos.push_back(nullptr);
+	life_ratings.push_back(0);
+	population_growth_modifiers.push_back(0);
+}
+
+void ProvinceState::reset_province(Province::index_t index) {
+	owners[index] = nullptr;
+	controllers[index] = nullptr;
+	total_populations[index] = 0;
+	rgos[index] = nullptr;
+	life_ratings[index] = 0;
+	population_growth_modifiers[index] = 0;
+}
+
+void ProvinceState::set_population_growth_modifier(Province::index_t index, fixed_point_t modifier) {
+	population_growth_modifiers[index] = modifier;
+}
+
+size_t ProvinceState::get_province_count() const {
+	return owners.size() - 1;
+}
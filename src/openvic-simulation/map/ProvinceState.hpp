@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "openvic-simulation/map/Province.hpp"
+
+namespace OpenVic {
+	/* The province values read and written every tick, kept in one contiguous column per value rather than in the
+	 * provinces themselves, which are mostly data only used when loading such as identifiers, positions and adjacencies.
+	 * Passes over a single value of every province, such as mapmodes and map-wide aggregates, then stream through a
+	 * small array instead of touching a whole Province for each one. Columns are indexed by Province::index_t, with
+	 * entry 0 belonging to NULL_INDEX and always holding the default value. Province's getters for these values read
+	 * them from here. */
+	struct ProvinceState {
+		friend struct Map;
+		friend struct Province;
+
+	private:
+		std::vector<Country const*> PROPERTY(owners);
+		std::vector<Country const*> PROPERTY(controllers);
+		std::vector<Pop::pop_size_t> PROPERTY(total_populations);
+		std::vector<Good const*> PROPERTY(rgos);
+		std::vector<Province::life_rating_t> PROPERTY(life_ratings);
+		/* The sum of the population growth modifier effects of the province's terrain and buildings, added to its monthly
+		 * growth rate. Set by the province's state update. */
+		std::vector<fixed_point_t> PROPERTY(population_growth_modifiers);
+
+		/* Appends default values for the next province. */
+		void add_province();
+		/* Sets a province's values back to their defaults. */
+		void reset_province(Province::index_t index);
+
+	public:
+		ProvinceState();
+
+		/* The number of provinces, not counting the NULL_INDEX entry. */
+		size_t get_province_count() const;
+
+		/* Defined here so per-province reads in hot loops are inlined. */
+		Country const* get_owner(Province::index_t index) const {
+			return owners[index];
+		}
+		Country const* get_controller(Province::index_t index) const {
+			return controllers[index];
+		}
+		Pop::pop_size_t get_total_population(Province::index_t index) const {
+			return total_populations[index];
+		}
+		Good const* get_rgo(Province::index_t index) const {
+			return rgos[index];
+		}
+		Province::life_rating_t get_life_rating(Province::index_t index) const {
+			return life_ratings[index];
+		}
+		fixed_point_t get_population_growth_modifier(Province::index_t index) const {
+			return population_growth_modifiers[index];
+		}
+
+		void set_population_growth_modifier(Province::index_t index, fixed_point_t modifier);
+	};
+}
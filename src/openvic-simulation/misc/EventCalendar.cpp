@@ -0,0 +1,124 @@
+#include "EventCalendar.hpp"
+
+#include "openvic-simulation/utility/Logger.hpp"
+#include "openvic-simulation/utility/Profiler.hpp"
+
+using namespace OpenVic;
+
+EventCalendar::EventCalendar() {}
+
+EventCalendar::day_t EventCalendar::_to_day(Date date) {
+	return static_cast<day_t>(date - Date {});
+}
+
+void EventCalendar::reset(Date date) {
+	for (bucket_t& bucket : day_wheel) {
+		bucket.clear();
+	}
+	for (bucket_t& bucket : span_wheel) {
+		bucket.clear();
+	}
+	overflow.clear();
+	overdue.clear();
+	pending.clear();
+	current_day = _to_day(date);
+}
+
+Date EventCalendar::get_current_date() const {
+	return Date { Timespan { current_day } };
+}
+
+void EventCalendar::_insert(event_t&& event, day_t earliest_wheel_day) {
+	if (event.due_day < earliest_wheel_day) {
+		overdue.push_back(std::move(event));
+	} else if (event.due_day - current_day < static_cast<day_t>(WHEEL_SIZE)) {
+		day_wheel[event.due_day & WHEEL_MASK].push_back(std::move(event));
+	} else if ((event.due_day >> WHEEL_BITS) - (current_day >> WHEEL_BITS) < static_cast<day_t>(WHEEL_SIZE)) {
+		span_wheel[(event.due_day >> WHEEL_BITS) & WHEEL_MASK].push_back(std::move(event));
+	} else {
+		const day_t due_day = event.due_day;
+		overflow.emplace(due_day, std::move(event));
+	}
+}
+
+EventCalendar::event_id_t EventCalendar::schedule(Date date, callback_t&& callback) {
+	if (!callback) {
+		Logger::error("Trying to schedule a null calendar event for ", date);
+		return NULL_EVENT_ID;
+	}
+	const event_id_t id = ++last_event_id;
+	/* Today's bucket has already fired, so anything due today or earlier has to wait for the next advance. */
+	_insert({ id, _to_day(date), std::move(callback) }, current_day + 1);
+	pending.insert(id);
+	return id;
+}
+
+bool EventCalendar::cancel(event_id_t id) {
+	if (id == NULL_EVENT_ID || id > last_event_id) {
+		Logger::error("Trying to cancel invalid calendar event id ", id);
+		return false;
+	}
+	return pending.erase(id) > 0;
+}
+
+size_t EventCalendar::get_pending_count() const {
+	return pending.size();
+}
+
+void EventCalendar::_fire(event_t& event, Date date) {
+	if (pending.erase(event.id) == 0) {
+		return;
+	}
+	OV_PROFILE_COUNTER("Calendar events fired", 1);
+	event.callback(date);
+}
+
+void EventCalendar::_fire_bucket(bucket_t& bucket, Date date) {
+	/* Callbacks may schedule new events, possibly into this same bucket, so fire from a detached copy. */
+	bucket_t firing;
+	firing.swap(bucket);
+	for (event_t& event : firing) {
+		_fire(event, date);
+	}
+	if (bucket.empty()) {
+		/* Hand the allocation back to avoid reallocating the bucket next time round the wheel. */
+		firing.clear();
+		bucket.swap(firing);
+	}
+}
+
+void EventCalendar::_advance_one_day() {
+	current_day++;
+
+	if ((current_day & ((WHEEL_MASK << WHEEL_BITS) | WHEEL_MASK)) == 0) {
+		/* The span wheel has come full circle, so pull the overflow events now within its range. */
+		const day_t range_end = ((current_day >> WHEEL_BITS) + static_cast<day_t>(WHEEL_SIZE)) << WHEEL_BITS;
+		while (!overflow.empty() && overflow.begin()->first < range_end) {
+			event_t event = std::move(overflow.begin()->second);
+			overflow.erase(overflow.begin());
+			_insert(std::move(event), current_day);
+		}
+	}
+	if ((current_day & WHEEL_MASK) == 0) {
+		/* Cascade the span bucket starting today down into the day wheel. */
+		bucket_t& span_bucket = span_wheel[(current_day >> WHEEL_BITS) & WHEEL_MASK];
+		bucket_t cascading;
+		cascading.swap(span_bucket);
+		for (event_t& event : cascading) {
+			_insert(std::move(event), current_day);
+		}
+	}
+
+	_fire_bucket(day_wheel[current_day & WHEEL_MASK], get_current_date());
+}
+
+void EventCalendar::advance_to(Date date) {
+	OV_PROFILE_SCOPE("EventCalendar::advance_to");
+	const day_t target_day = _to_day(date);
+	if (!overdue.empty()) {
+		_fire_bucket(overdue, get_current_date());
+	}
+	while (current_day < target_day) {
+		_advance_one_day();
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+#include "openvic-simulation/types/Date.hpp"
+
+namespace OpenVic {
+	/* Simulation-wide queue of callbacks keyed by the date they are due on, so timed effects (building expansion,
+	 * modifier expiry, ...) only cost anything on the days they actually happen.
+	 *
+	 * Events are stored in a hierarchical timer wheel: a wheel of single-day buckets covering the next 64 days, a wheel of
+	 * 64-day buckets covering roughly the next 11 years, and an ordered overflow map for anything further away. Advancing
+	 * a day touches a single day bucket, with coarser buckets cascading down into finer ones as they come into range. */
+	struct EventCalendar {
+		using callback_t = std::function<void(Date)>;
+		using event_id_t = uint64_t;
+
+		static constexpr event_id_t NULL_EVENT_ID = 0;
+
+	private:
+		using day_t = Timespan::day_t;
+
+		struct event_t {
+			event_id_t id;
+			day_t due_day;
+			callback_t callback;
+		};
+
+		static constexpr size_t WHEEL_BITS = 6;
+		static constexpr size_t WHEEL_SIZE = 1 << WHEEL_BITS;
+		static constexpr day_t WHEEL_MASK = WHEEL_SIZE - 1;
+
+		using bucket_t = std::vector<event_t>;
+
+		std::array<bucket_t, WHEEL_SIZE> day_wheel;
+		std::array<bucket_t, WHEEL_SIZE> span_wheel;
+		std::multimap<day_t, event_t> overflow;
+		/* Events scheduled on or before the current day, fired at the start of the next advance. */
+		bucket_t overdue;
+
+		/* Ids of events which have been scheduled but have neither fired nor been cancelled. Cancelled events stay in
+		 * their bucket and are skipped when it fires, as their ids are no longer in here. */
+		std::unordered_set<event_id_t> pending;
+		day_t current_day = 0;
+		event_id_t last_event_id = NULL_EVENT_ID;
+
+		static day_t _to_day(Date date);
+
+		/* Events due before earliest_wheel_day go into the overdue list rather than the wheels. */
+		void _insert(event_t&& event, day_t earliest_wheel_day);
+		void _fire(event_t& event, Date date);
+		void _fire_bucket(bucket_t& bucket, Date date);
+		void _advance_one_day();
+
+	public:
+		EventCalendar();
+
+		/* Clears all scheduled events and sets the calendar's current date. */
+		void reset(Date date);
+		Date get_current_date() const;
+
+		/* Schedules callback to run when the calendar is advanced to date. Events for the current date or earlier run at
+		 * the start of the next call to advance_to. Returns an id which can be passed to cancel. */
+		event_id_t schedule(Date date, callback_t&& callback);
+		/* Returns false if the event has already fired or been cancelled. */
+		bool cancel(event_id_t id);
+		size_t get_pending_count() const;
+
+		/* Advances day by day up to and including date, running every event due along the way. */
+		void advance_to(Date date);
+	};
+}
@@ -24,7 +24,7 @@ size_t ModifierValue::get_effect_count() const {
 	return values.size();
 }
 
-fixed_point_t ModifierValue::get_effect(ModifierEffect const* effect, bool* successful) {
+fixed_point_t ModifierValue::get_effect(ModifierEffect const* effect, bool* successful) const {
 	const effect_map_t::const_iterator it = values.find(effect);
 	if (it != values.end()) {
 		if (successful != nullptr) {
@@ -51,7 +51,7 @@ namespace OpenVic {
 		void trim();
 		size_t get_effect_count() const;
 
-		fixed_point_t get_effect(ModifierEffect const* effect, bool* successful = nullptr);
+		fixed_point_t get_effect(ModifierEffect const* effect, bool* successful = nullptr) const;
 		bool has_effect(ModifierEffect const* effect) const;
 
 		ModifierValue& operator+=(ModifierValue const& right);
@@ -11,7 +11,8 @@ using namespace OpenVic::NodeTools;
 
 Pop::Pop(
 	PopType const& new_type, Culture const& new_culture, Religion const& new_religion, pop_size_t new_size
-) : type { new_type }, culture { new_culture }, religion { new_religion }, size { new_size } {
+) : type { new_type }, culture { new_culture }, religion { new_religion }, size { new_size },
+	growth_remainder { 0 } {
 	assert(size > 0);
 }
 
@@ -159,3 +160,40 @@ bool PopManager::load_pop_into_province(Province& province, std::string_view pop
 	}
 	return ret;
 }
+
+void PopManager::save_pop_snapshot(BinaryWriter& writer, Pop const& pop) const {
+	writer.write_index(get_pop_types(), &pop.type);
+	writer.write_index(culture_manager.get_cultures(), &pop.culture);
+	writer.write_index(religion_manager.get_religions(), &pop.religion);
+	writer.write(pop.size);
+	writer.write(pop.num_promoted);
+	writer.write(pop.num_demoted);
+	writer.write(pop.num_migrated);
+	writer.write(pop.growth_remainder);
+}
+
+bool PopManager::load_pop_snapshot_into_province(BinaryReader& reader, Province& province) const {
+	PopType const* type = nullptr;
+	Culture const* culture = nullptr;
+	Religion const* religion = nullptr;
+	Pop::pop_size_t size, num_promoted, num_demoted, num_migrated;
+	fixed_point_t growth_remainder;
+	if (!(
+		reader.read_non_null_index(get_pop_types(), type) &&
+		reader.read_non_null_index(culture_manager.get_cultures(), culture) &&
+		reader.read_non_null_index(religion_manager.get_religions(), religion) && reader.read(size) &&
+		reader.read(num_promoted) && reader.read(num_demoted) && reader.read(num_migrated) && reader.read(growth_remainder)
+	)) {
+		return false;
+	}
+	if (size <= 0 || growth_remainder < 0 || growth_remainder >= 1) {
+		Logger::error("Snapshot has invalid pop with size ", size, " and growth remainder ", growth_remainder);
+		return false;
+	}
+	Pop pop { *type, *culture, *religion, size };
+	pop.num_promoted = num_promoted;
+	pop.num_demoted = num_demoted;
+	pop.num_migrated = num_migrated;
+	pop.growth_remainder = growth_remainder;
+	return province.add_pop(std::move(pop));
+}
@@ -4,6 +4,7 @@
 #include "openvic-simulation/military/Unit.hpp"
 #include "openvic-simulation/pop/Culture.hpp"
 #include "openvic-simulation/pop/Religion.hpp"
+#include "openvic-simulation/utility/BinaryStream.hpp"
 
 namespace OpenVic {
 
@@ -15,6 +16,7 @@ namespace OpenVic {
 	 */
 	struct Pop {
 		friend struct PopManager;
+		friend struct PopStore;
 
 		using pop_size_t = int64_t;
 
@@ -26,6 +28,9 @@ namespace OpenVic {
 		pop_size_t PROPERTY(num_promoted);
 		pop_size_t PROPERTY(num_demoted);
 		pop_size_t PROPERTY(num_migrated);
+		/* The fraction of a person the pop has grown by without it yet adding up to a whole one, carried between
+		 * demographic updates so slow growth still adds up. Always in [0, 1). */
+		fixed_point_t PROPERTY(growth_remainder);
 
 		Pop(PopType const& new_type, Culture const& new_culture, Religion const& new_religion, pop_size_t new_size);
 
@@ -101,5 +106,13 @@ namespace OpenVic {
 			std::string_view filestem, UnitManager const& unit_manager, GoodManager const& good_manager, ast::NodeCPtr root
 		);
 		bool load_pop_into_province(Province& province, std::string_view pop_type_identifier, ast::NodeCPtr pop_node) const;
+
+		/* The number of bytes save_pop_snapshot writes for each pop: its type, culture and religion indices, its size, its
+		 * three counters and its growth remainder. */
+		static constexpr size_t POP_SNAPSHOT_SIZE =
+			3 * sizeof(BinaryWriter::index_t) + 4 * sizeof(Pop::pop_size_t) + sizeof(fixed_point_t);
+
+		void save_pop_snapshot(BinaryWriter& writer, Pop const& pop) const;
+		bool load_pop_snapshot_into_province(BinaryReader& reader, Province& province) const;
 	};
 }
@@ -0,0 +1,396 @@
+#include "PopStore.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+
+#include "openvic-simulation/map/Province.hpp"
+#include "openvic-simulation/utility/Logger.hpp"
+
+using namespace OpenVic;
+
+static_assert(std::is_same_v<PopStore::province_index_t, Province::index_t>);
+
+PopStore::PopStore() : pop_manager { nullptr }, pop_count { 0 } {
+	reset(0);
+}
+
+void PopStore::set_pop_manager(PopManager const& new_pop_manager) {
+	pop_manager = &new_pop_manager;
+}
+
+void PopStore::reset(size_t province_count) {
+	_resize_rows(0);
+	province_ranges.assign(province_count + 1, { 0, 0, 0 });
+	slots.clear();
+	free_slots.clear();
+	hole_rows = 0;
+	pop_count = 0;
+}
+
+size_t PopStore::get_row_count() const {
+	return sizes.size();
+}
+
+PopStore::province_range_t PopStore::get_province_range(province_index_t province) const {
+	return province < province_ranges.size() ? province_ranges[province] : province_range_t { 0, 0, 0 };
+}
+
+void PopStore::_resize_rows(size_t row_count) {
+	types.resize(row_count, 0);
+	cultures.resize(row_count, 0);
+	religions.resize(row_count, 0);
+	sizes.resize(row_count, 0);
+	num_promoted.resize(row_count, 0);
+	num_demoted.resize(row_count, 0);
+	num_migrated.resize(row_count, 0);
+	growth_remainders.resize(row_count, 0);
+	row_slots.resize(row_count, 0);
+}
+
+void PopStore::_clear_row(size_t row) {
+	types[row] = 0;
+	cultures[row] = 0;
+	religions[row] = 0;
+	sizes[row] = 0;
+	num_promoted[row] = 0;
+	num_demoted[row] = 0;
+	num_migrated[row] = 0;
+	growth_remainders[row] = 0;
+}
+
+void PopStore::_move_row(size_t from, size_t to) {
+	types[to] = types[from];
+	cultures[to] = cultures[from];
+	religions[to] = religions[from];
+	sizes[to] = sizes[from];
+	num_promoted[to] = num_promoted[from];
+	num_demoted[to] = num_demoted[from];
+	num_migrated[to] = num_migrated[from];
+	growth_remainders[to] = growth_remainders[from];
+	row_slots[to] = row_slots[from];
+	slots[row_slots[to]].row = to;
+}
+
+void PopStore::_grow_province(province_range_t& range) {
+	const uint32_t new_capacity = std::max(MIN_PROVINCE_CAPACITY, range.capacity * 2);
+	if (range.begin + range.capacity == get_row_count()) {
+		/* The block is already at the end, so it can grow where it is. */
+		_resize_rows(range.begin + new_capacity);
+	} else {
+		const size_t new_begin = get_row_count();
+		_resize_rows(new_begin + new_capacity);
+		for (size_t idx = 0; idx < range.count; ++idx) {
+			_move_row(range.begin + idx, new_begin + idx);
+			_clear_row(range.begin + idx);
+		}
+		hole_rows += range.capacity;
+		range.begin = new_begin;
+	}
+	range.capacity = new_capacity;
+}
+
+void PopStore::_compact() {
+	/* The old row to fill each new row from. */
+	std::vector<uint32_t> source_rows;
+	source_rows.reserve(pop_count);
+	for (province_range_t& range : province_ranges) {
+		const uint32_t new_begin = source_rows.size();
+		for (uint32_t idx = 0; idx < range.count; ++idx) {
+			source_rows.push_back(range.begin + idx);
+		}
+		range.begin = new_begin;
+		range.capacity = range.count;
+	}
+
+	const auto permute = [&source_rows]<typename T>(std::vector<T>& column) -> void {
+		std::vector<T> new_column(source_rows.size());
+		for (size_t row = 0; row < source_rows.size(); ++row) {
+			new_column[row] = column[source_rows[row]];
+		}
+		column.swap(new_column);
+	};
+	permute(types);
+	permute(cultures);
+	permute(religions);
+	permute(sizes);
+	permute(num_promoted);
+	permute(num_demoted);
+	permute(num_migrated);
+	permute(growth_remainders);
+	permute(row_slots);
+	for (size_t row = 0; row < row_slots.size(); ++row) {
+		slots[row_slots[row]].row = row;
+	}
+	hole_rows = 0;
+}
+
+uint32_t PopStore::_add_row(province_index_t province) {
+	province_range_t& range = province_ranges[province];
+	if (range.count == range.capacity) {
+		if (hole_rows * 2 > get_row_count()) {
+			_compact();
+		}
+		_grow_province(range);
+	}
+
+	uint32_t slot_index;
+	if (!free_slots.empty()) {
+		slot_index = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		slot_index = slots.size();
+		slots.push_back({ 0, 1, Province::NULL_INDEX });
+	}
+	const uint32_t row = range.begin + range.count++;
+	slot_t& slot = slots[slot_index];
+	slot.row = row;
+	slot.province = province;
+	row_slots[row] = slot_index;
+	pop_count++;
+	return row;
+}
+
+void PopStore::_remove_row(uint32_t row) {
+	const uint32_t slot_index = row_slots[row];
+	province_range_t& range = province_ranges[slots[slot_index].province];
+	const uint32_t last_row = range.begin + --range.count;
+	if (row != last_row) {
+		_move_row(last_row, row);
+	}
+	_clear_row(last_row);
+	/* Invalidates every handle to the slot, skipping 0 so handles are never null. */
+	if (++slots[slot_index].generation == 0) {
+		slots[slot_index].generation = 1;
+	}
+	free_slots.push_back(slot_index);
+	pop_count--;
+}
+
+PopStore::handle_t PopStore::add_pop(province_index_t province, Pop const& pop) {
+	assert(pop_manager != nullptr);
+	if (province == Province::NULL_INDEX || province >= province_ranges.size()) {
+		Logger::error("Trying to add pop to invalid province index ", province);
+		return NULL_HANDLE;
+	}
+	const uint32_t row = _add_row(province);
+	types[row] = pop_manager->get_pop_type_index(pop.get_type());
+	cultures[row] = pop_manager->get_culture_manager().get_culture_index(pop.get_culture());
+	religions[row] = pop_manager->get_religion_manager().get_religion_index(pop.get_religion());
+	sizes[row] = pop.get_size();
+	num_promoted[row] = pop.get_num_promoted();
+	num_demoted[row] = pop.get_num_demoted();
+	num_migrated[row] = pop.get_num_migrated();
+	growth_remainders[row] = pop.get_growth_remainder().get_raw_value();
+	return get_handle(row);
+}
+
+PopStore::slot_t const* PopStore::_get_slot(handle_t handle) const {
+	const size_t slot_index = handle & 0xFFFFFFFF;
+	if (handle == NULL_HANDLE || slot_index >= slots.size() || slots[slot_index].generation != handle >> 32) {
+		return nullptr;
+	}
+	return &slots[slot_index];
+}
+
+bool PopStore::remove_pop(handle_t handle) {
+	slot_t const* slot = _get_slot(handle);
+	if (slot == nullptr) {
+		Logger::error("Trying to remove pop with invalid handle ", handle);
+		return false;
+	}
+	_remove_row(slot->row);
+	return true;
+}
+
+void PopStore::clear_province(province_index_t province) {
+	if (province >= province_ranges.size()) {
+		return;
+	}
+	province_range_t& range = province_ranges[province];
+	for (uint32_t row = range.begin; row < range.begin + range.count; ++row) {
+		const uint32_t slot_index = row_slots[row];
+		if (++slots[slot_index].generation == 0) {
+			slots[slot_index].generation = 1;
+		}
+		free_slots.push_back(slot_index);
+		_clear_row(row);
+	}
+	pop_count -= range.count;
+	range.count = 0;
+}
+
+/* Scales a pop size by a raw fixed point rate, rounding to the nearest integer with halves rounded away from zero, so
+ * that rates of either sign give counters of the same magnitude. */
+static constexpr Pop::pop_size_t scale_size(Pop::pop_size_t size, int64_t raw_rate) {
+	constexpr int64_t half = int64_t { 1 } << (fixed_point_t::PRECISION - 1);
+	const int64_t product = size * raw_rate;
+	return product >= 0 ? (product + half) >> fixed_point_t::PRECISION : -((half - product) >> fixed_point_t::PRECISION);
+}
+
+/* Each province's rates are applied to its block of rows in separate passes per column, so every pass is a plain loop
+ * over contiguous integers the compiler can vectorise. Sizes are scaled by raw fixed point rates in integer arithmetic,
+ * so results are identical on every platform. Growth is rounded down to whole people with the fraction left over kept
+ * in the pop's remainder and added to its next growth, rather than rounded per update, as rounding would leave any pop
+ * too small to gain half a person in one update never growing at all. */
+void PopStore::update_demographics(size_t begin, size_t end, std::span<const demographic_rates_t> rates) {
+	assert(end <= province_ranges.size() && end <= rates.size());
+	for (size_t province = begin; province < end; ++province) {
+		const province_range_t range = province_ranges[province];
+		if (range.count == 0) {
+			continue;
+		}
+		demographic_rates_t const& province_rates = rates[province];
+		Pop::pop_size_t const* size_column = sizes.data() + range.begin;
+
+		const auto fill_counter = [range, size_column](Pop::pop_size_t* counter_column, fixed_point_t rate) -> void {
+			const int64_t raw_rate = rate.get_raw_value();
+			for (size_t idx = 0; idx < range.count; ++idx) {
+				counter_column[idx] = scale_size(size_column[idx], raw_rate);
+			}
+		};
+		fill_counter(num_promoted.data() + range.begin, province_rates.promotion);
+		fill_counter(num_demoted.data() + range.begin, province_rates.demotion);
+		fill_counter(num_migrated.data() + range.begin, province_rates.migration);
+
+		const int64_t raw_growth = province_rates.growth.get_raw_value();
+		Pop::pop_size_t* growing_sizes = sizes.data() + range.begin;
+		int64_t* remainders = growth_remainders.data() + range.begin;
+		for (size_t idx = 0; idx < range.count; ++idx) {
+			const Pop::pop_size_t size = growing_sizes[idx];
+			const int64_t raw_change = size * raw_growth + remainders[idx];
+			/* The arithmetic shift rounds down, so the remainder left is never negative, even when shrinking. */
+			const Pop::pop_size_t change = raw_change >> fixed_point_t::PRECISION;
+			remainders[idx] = raw_change - (change << fixed_point_t::PRECISION);
+			growing_sizes[idx] = std::max<Pop::pop_size_t>(size + change, 1);
+		}
+	}
+}
+
+/* The share of value given to piece piece_index when splitting it into piece_count pieces, with the remainder spread over
+ * the first pieces so the shares add back up to value. */
+static constexpr Pop::pop_size_t split_share(Pop::pop_size_t value, Pop::pop_size_t piece_count, Pop::pop_size_t piece_index) {
+	return value / piece_count + (piece_index < value % piece_count ? 1 : 0);
+}
+
+bool PopStore::consolidate_province(province_index_t province) {
+	assert(pop_manager != nullptr);
+	if (province >= province_ranges.size() || province_ranges[province].count == 0) {
+		return false;
+	}
+	std::vector<PopType> const& pop_types = pop_manager->get_pop_types();
+
+	/* Each small pop is merged into the first earlier small pop with the same type, culture and religion, which stops
+	 * taking merges once it reaches its type's merge_max_size. Merges which would take the target past its type's
+	 * max_size are skipped, as the split pass would only cut the result back into pieces small enough to merge again. */
+	merge_targets.clear();
+	merged_rows.clear();
+	const province_range_t range = province_ranges[province];
+	for (uint32_t row = range.begin; row < range.begin + range.count; ++row) {
+		PopType const& pop_type = pop_types[types[row]];
+		const Pop::pop_size_t merge_max_size = pop_type.get_merge_max_size();
+		if (sizes[row] >= merge_max_size) {
+			continue;
+		}
+		const uint64_t key = static_cast<uint64_t>(types[row]) << 32 | static_cast<uint64_t>(cultures[row]) << 16 |
+			religions[row];
+		const std::pair<decltype(merge_targets)::iterator, bool> target = merge_targets.emplace(key, row);
+		if (target.second) {
+			continue;
+		}
+		const uint32_t target_row = target.first->second;
+		const Pop::pop_size_t max_size = pop_type.get_max_size();
+		if (max_size > 0 && sizes[target_row] + sizes[row] > max_size) {
+			continue;
+		}
+		sizes[target_row] += sizes[row];
+		num_promoted[target_row] += num_promoted[row];
+		num_demoted[target_row] += num_demoted[row];
+		num_migrated[target_row] += num_migrated[row];
+		/* Two remainders may add up to a whole person, which joins the merged pop. */
+		growth_remainders[target_row] += growth_remainders[row];
+		if (growth_remainders[target_row] >= fixed_point_t::ONE) {
+			growth_remainders[target_row] -= fixed_point_t::ONE;
+			sizes[target_row]++;
+		}
+		merged_rows.push_back(row);
+		if (sizes[target_row] >= merge_max_size) {
+			merge_targets.erase(target.first);
+		}
+	}
+	/* Removing rows from the highest down means the rows moved into their places are never ones still to be removed. */
+	for (std::vector<uint32_t>::const_reverse_iterator it = merged_rows.rbegin(); it != merged_rows.rend(); ++it) {
+		_remove_row(*it);
+	}
+	bool changed = !merged_rows.empty();
+
+	/* Each pop larger than its type's max_size is split into the fewest equal pieces no larger than it, with the first
+	 * piece keeping the growth remainder. The new pops are added after the province's existing ones, so are not visited
+	 * again. */
+	const uint32_t count = province_ranges[province].count;
+	for (uint32_t idx = 0; idx < count; ++idx) {
+		uint32_t row = province_ranges[province].begin + idx;
+		const Pop::pop_size_t max_size = pop_types[types[row]].get_max_size();
+		if (max_size <= 0 || sizes[row] <= max_size) {
+			continue;
+		}
+		const Pop::pop_size_t size = sizes[row], promoted = num_promoted[row], demoted = num_demoted[row],
+			migrated = num_migrated[row];
+		const Pop::pop_size_t piece_count = (size + max_size - 1) / max_size;
+		for (Pop::pop_size_t piece = 1; piece < piece_count; ++piece) {
+			const uint32_t new_row = _add_row(province);
+			/* Adding a row may have moved the province's block. */
+			row = province_ranges[province].begin + idx;
+			types[new_row] = types[row];
+			cultures[new_row] = cultures[row];
+			religions[new_row] = religions[row];
+			sizes[new_row] = split_share(size, piece_count, piece);
+			num_promoted[new_row] = split_share(promoted, piece_count, piece);
+			num_demoted[new_row] = split_share(demoted, piece_count, piece);
+			num_migrated[new_row] = split_share(migrated, piece_count, piece);
+			growth_remainders[new_row] = 0;
+		}
+		sizes[row] = split_share(size, piece_count, 0);
+		num_promoted[row] = split_share(promoted, piece_count, 0);
+		num_demoted[row] = split_share(demoted, piece_count, 0);
+		num_migrated[row] = split_share(migrated, piece_count, 0);
+		changed = true;
+	}
+	return changed;
+}
+
+bool PopStore::is_valid(handle_t handle) const {
+	return _get_slot(handle) != nullptr;
+}
+
+size_t PopStore::get_row(handle_t handle) const {
+	slot_t const* slot = _get_slot(handle);
+	assert(slot != nullptr);
+	return slot->row;
+}
+
+PopStore::handle_t PopStore::get_handle(size_t row) const {
+	const uint32_t slot_index = row_slots[row];
+	return (static_cast<handle_t>(slots[slot_index].generation) << 32) | slot_index;
+}
+
+Pop PopStore::get_pop(size_t row) const {
+	Pop pop { get_type(row), get_culture(row), get_religion(row), sizes[row] };
+	pop.num_promoted = num_promoted[row];
+	pop.num_demoted = num_demoted[row];
+	pop.num_migrated = num_migrated[row];
+	pop.growth_remainder = fixed_point_t::parse_raw(growth_remainders[row]);
+	return pop;
+}
+
+PopType const& PopStore::get_type(size_t row) const {
+	return pop_manager->get_pop_types()[types[row]];
+}
+
+Culture const& PopStore::get_culture(size_t row) const {
+	return pop_manager->get_culture_manager().get_cultures()[cultures[row]];
+}
+
+Religion const& PopStore::get_religion(size_t row) const {
+	return pop_manager->get_religion_manager().get_religions()[religions[row]];
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "openvic-simulation/pop/Pop.hpp"
+
+namespace OpenVic {
+	/* Every pop on the map, stored as one column per value rather than as Pop objects, so kernels going over pops read
+	 * contiguous arrays. Types, cultures and religions are stored as indices into the pop manager's registries, which
+	 * must be set with set_pop_manager before any pops are added.
+	 *
+	 * Each province's pops are a contiguous block of rows, followed by spare capacity. When a province's block is full
+	 * it is moved to the end of the columns with double the capacity, leaving a hole behind, and once holes make up
+	 * more than half the rows every block is packed together again, so adding pops takes amortised constant time.
+	 * Rows not holding a pop have size 0, so kernels may also run over whole columns. Rows move when blocks are moved or
+	 * pops are removed, so pops are referred to from outside by handles, which stay valid until the pop is removed. */
+	struct PopStore {
+		/* Generation in the top 32 bits, slot index in the bottom 32. Generations start at 1, so a handle is never 0. */
+		using handle_t = uint64_t;
+		/* The same type as Province::index_t, as Province.hpp can't be included here. */
+		using province_index_t = uint16_t;
+		using type_index_t = uint16_t;
+		using culture_index_t = uint16_t;
+		using religion_index_t = uint16_t;
+
+		static constexpr handle_t NULL_HANDLE = 0;
+
+		/* The rows holding a province's pops are [begin, begin + count). */
+		struct province_range_t {
+			uint32_t begin;
+			uint32_t count;
+			uint32_t capacity;
+		};
+
+		/* The changes to a province's pops over one demographic update, as fractions of each pop's size. */
+		struct demographic_rates_t {
+			fixed_point_t growth;
+			fixed_point_t promotion;
+			fixed_point_t demotion;
+			fixed_point_t migration;
+		};
+
+	private:
+		/* Tracks where the pop with a handle is. A free slot's row is unused and its generation is that of the next
+		 * handle to use it. */
+		struct slot_t {
+			uint32_t row;
+			uint32_t generation;
+			province_index_t province;
+		};
+
+		static constexpr uint32_t MIN_PROVINCE_CAPACITY = 4;
+
+		PopManager const* PROPERTY(pop_manager);
+
+		std::vector<type_index_t> PROPERTY(types);
+		std::vector<culture_index_t> PROPERTY(cultures);
+		std::vector<religion_index_t> PROPERTY(religions);
+		std::vector<Pop::pop_size_t> PROPERTY(sizes);
+		std::vector<Pop::pop_size_t> PROPERTY(num_promoted);
+		std::vector<Pop::pop_size_t> PROPERTY(num_demoted);
+		std::vector<Pop::pop_size_t> PROPERTY(num_migrated);
+		/* Each pop's growth remainder as a raw fixed point value, kept raw so growth runs in integer arithmetic. */
+		std::vector<int64_t> PROPERTY(growth_remainders);
+		/* The slot of the pop in each row, unused for rows without a pop. */
+		std::vector<uint32_t> row_slots;
+
+		/* Indexed by province index, with entry 0 belonging to Province::NULL_INDEX and always empty. */
+		std::vector<province_range_t> province_ranges;
+		std::vector<slot_t> slots;
+		/* Slots of removed pops, reused by the next pops added before any new slots are allocated. */
+		std::vector<uint32_t> free_slots;
+		/* Rows inside no province's block. */
+		size_t hole_rows = 0;
+		size_t PROPERTY(pop_count);
+		/* Scratch space for consolidate_province, kept so repeated passes reuse their storage. */
+		std::unordered_map<uint64_t, uint32_t> merge_targets;
+		std::vector<uint32_t> merged_rows;
+
+		void _resize_rows(size_t row_count);
+		void _clear_row(size_t row);
+		/* Copies a row's values and moves its pop's slot to follow it. */
+		void _move_row(size_t from, size_t to);
+		void _grow_province(province_range_t& range);
+		/* Packs every province's block together, each with capacity for exactly its current pops. */
+		void _compact();
+		slot_t const* _get_slot(handle_t handle) const;
+		/* Appends an empty row to the province's block, with a newly allocated slot. */
+		uint32_t _add_row(province_index_t province);
+		/* Moves the last row of the row's province into it and frees the row's slot. */
+		void _remove_row(uint32_t row);
+
+	public:
+		PopStore();
+
+		void set_pop_manager(PopManager const& new_pop_manager);
+
+		/* Removes every pop and sets the number of provinces. */
+		void reset(size_t province_count);
+		size_t get_row_count() const;
+		province_range_t get_province_range(province_index_t province) const;
+
+		/* The pop's type, culture and religion must come from the pop manager's registries. */
+		handle_t add_pop(province_index_t province, Pop const& pop);
+		/* Moves the last pop of the province into the removed pop's row, so the order of the province's pops changes. */
+		bool remove_pop(handle_t handle);
+		void clear_province(province_index_t province);
+
+		/* Merges pops smaller than their type's merge_max_size with others of the same type, culture and religion, and
+		 * splits pops larger than their type's max_size, keeping the total size and counters of the province's pops
+		 * the same. Handles to merged pops become invalid. Returns whether any pops were merged or split. */
+		bool consolidate_province(province_index_t province);
+
+		/* Grows or shrinks the pops of provinces [begin, end) by their province's growth rate, carrying each pop's
+		 * fraction of a person over to the next update and keeping every pop at size 1 or more, and sets their promotion, demotion and migration counters to their province's rates of their
+		 * size before growth. rates is indexed by province index. Provinces' rows never overlap, so disjoint province
+		 * ranges may be updated concurrently. */
+		void update_demographics(size_t begin, size_t end, std::span<const demographic_rates_t> rates);
+
+		bool is_valid(handle_t handle) const;
+		/* The row the pop is in, which only stays the same until pops are next added or removed. */
+		size_t get_row(handle_t handle) const;
+		handle_t get_handle(size_t row) const;
+
+		/* Rebuilds a Pop from a row. */
+		Pop get_pop(size_t row) const;
+		PopType const& get_type(size_t row) const;
+		Culture const& get_culture(size_t row) const;
+		Religion const& get_religion(size_t row) const;
+	};
+}
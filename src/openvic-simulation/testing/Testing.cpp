@@ -22,6 +22,8 @@ Testing::Testing(GameManager* game_manager) {
 	test_scripts.push_back(a_005_nation_tests);
 	A_006_politics_tests* a_006_politics_tests = new A_006_politics_tests();
 	test_scripts.push_back(a_006_politics_tests);
+	A_007_calendar_tests* a_007_calendar_tests = new A_007_calendar_tests();
+	test_scripts.push_back(a_007_calendar_tests);
 
 	for (auto test_script : test_scripts) {
 		test_script->set_game_manager(game_manager);
@@ -10,6 +10,7 @@
 #include "openvic-simulation/testing/test_scripts/A_004_networking_tests.cpp"
 #include "openvic-simulation/testing/test_scripts/A_005_nation_tests.cpp"
 #include "openvic-simulation/testing/test_scripts/A_006_politics_tests.cpp"
+#include "openvic-simulation/testing/test_scripts/A_007_calendar_tests.cpp"
 
 namespace OpenVic {
 
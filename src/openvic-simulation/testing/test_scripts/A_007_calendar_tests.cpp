@@ -0,0 +1,118 @@
+#include <string>
+#include <vector>
+
+#include "openvic-simulation/GameManager.hpp"
+#include "openvic-simulation/misc/EventCalendar.hpp"
+#include "openvic-simulation/testing/TestScript.hpp"
+
+namespace OpenVic {
+	class A_007_calendar_tests : public TestScript {
+
+		using day_t = Timespan::day_t;
+
+		struct test_event_t {
+			day_t due_day;
+			EventCalendar::event_id_t id;
+			bool cancelled;
+			size_t fire_count;
+			day_t fired_day;
+		};
+
+		/* Covering the day wheel's edge, the span wheel's edge and the overflow map. */
+		static constexpr day_t DISTANCES[] { 0, 1, 63, 64, 65, 4095, 4096, 4097, 10000 };
+		/* Start days on and either side of day and span wheel boundaries, so events land on the boundaries too. */
+		static constexpr day_t START_DAYS[] { 0, 1, 63, 64, 4031, 4032, 4095, 4096, 8191, 12287 };
+
+		static day_t to_day(Date date) {
+			return static_cast<day_t>(date - Date {});
+		}
+
+		/* Schedules an event at each distance from start_day, plus events landing exactly on the next day and span wheel
+		 * boundaries, cancels every other one if cancel_alternate is set, and advances past them all. Returns the number
+		 * of failures: events not firing exactly once on their due day, cancelled events firing, and cancel accepting
+		 * ids it should have rejected. */
+		static size_t run_events(day_t start_day, bool cancel_alternate) {
+			std::vector<day_t> due_days;
+			for (const day_t distance : DISTANCES) {
+				due_days.push_back(start_day + distance);
+			}
+			for (const day_t boundary : { day_t { 64 }, day_t { 4096 } }) {
+				const day_t next_boundary = (start_day / boundary + 1) * boundary;
+				due_days.push_back(next_boundary - 1);
+				due_days.push_back(next_boundary);
+			}
+
+			EventCalendar calendar;
+			calendar.reset(Date { Timespan { start_day } });
+			std::vector<test_event_t> events(due_days.size());
+			day_t last_day = start_day;
+			for (size_t idx = 0; idx < due_days.size(); ++idx) {
+				test_event_t& event = events[idx];
+				event = { due_days[idx], EventCalendar::NULL_EVENT_ID, false, 0, 0 };
+				event.id = calendar.schedule(Date { Timespan { event.due_day } }, [&event](Date today) -> void {
+					event.fire_count++;
+					event.fired_day = to_day(today);
+				});
+				last_day = std::max(last_day, event.due_day);
+			}
+
+			size_t failures = 0;
+			if (cancel_alternate) {
+				for (size_t idx = 0; idx < events.size(); idx += 2) {
+					events[idx].cancelled = true;
+					failures += calendar.cancel(events[idx].id) ? 0 : 1;
+					failures += calendar.cancel(events[idx].id) ? 1 : 0;
+				}
+			}
+
+			/* Advancing in two steps checks the overdue list and that wheel positions carry over between calls. */
+			calendar.advance_to(Date { Timespan { start_day + (last_day - start_day) / 2 } });
+			calendar.advance_to(Date { Timespan { last_day + 1 } });
+
+			for (test_event_t const& event : events) {
+				if (event.cancelled) {
+					failures += event.fire_count != 0 ? 1 : 0;
+				} else {
+					failures += event.fire_count != 1 || event.fired_day != event.due_day ? 1 : 0;
+					/* Fired events are no longer pending, so can't be cancelled. */
+					failures += calendar.cancel(event.id) ? 1 : 0;
+				}
+			}
+			failures += calendar.get_pending_count() != 0 ? 1 : 0;
+			return failures;
+		}
+
+	public:
+		A_007_calendar_tests() {
+			set_script_name("A_007_calendar_tests");
+			add_requirements();
+		}
+
+		void add_requirements() {
+			Requirement* CAL_1 = new Requirement(
+				"CAL_1",
+				"Calendar events shall fire exactly once, on their due date, at any distance from the current date and on "
+				"any day relative to the calendar's wheel boundaries",
+				"Events scheduled 0 to 10000 days ahead from dates around wheel boundaries fire once each on their due date"
+			);
+			add_requirement(CAL_1);
+			Requirement* CAL_2 = new Requirement(
+				"CAL_2",
+				"Cancelled calendar events shall never fire, and events shall only be cancellable while pending",
+				"Cancelled events do not fire, the rest fire once on their due date, and cancelling a cancelled or fired "
+				"event fails"
+			);
+			add_requirement(CAL_2);
+		}
+
+		void execute_script() {
+			size_t fire_failures = 0, cancel_failures = 0;
+			for (const day_t start_day : START_DAYS) {
+				fire_failures += run_events(start_day, false);
+				cancel_failures += run_events(start_day, true);
+			}
+			pass_or_fail_req_with_actual_and_target_values("CAL_1", "0", std::to_string(fire_failures));
+			pass_or_fail_req_with_actual_and_target_values("CAL_2", "0", std::to_string(cancel_failures));
+		}
+	};
+}
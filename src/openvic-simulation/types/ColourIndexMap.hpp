@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "openvic-simulation/types/Colour.hpp"
+
+namespace OpenVic {
+	/* Flat open-addressing hash table from non-null 24-bit RGB colours to indices, used to identify provinces from the
+	 * colours in the province shape image. Lookups hash the colour and probe linearly through a contiguous array of
+	 * slots, so a hit usually costs a single cache miss, unlike the pointer chasing of a tree-based map. NULL_COLOUR
+	 * marks empty slots, so it cannot be used as a key, and the table is never more than half full. */
+	template<typename IndexType>
+	struct ColourIndexMap {
+		using index_t = IndexType;
+
+	private:
+		struct slot_t {
+			colour_t colour;
+			index_t index;
+		};
+
+		static constexpr size_t MIN_CAPACITY = 16;
+
+		std::vector<slot_t> slots;
+		size_t mask = 0, count = 0;
+		index_t null_index;
+
+		/* Fibonacci hashing, spreading the colour bits across the table's index bits. */
+		size_t _get_home_slot(colour_t colour) const {
+			return static_cast<size_t>((static_cast<uint64_t>(colour) * 0x9E3779B97F4A7C15) >> 32) & mask;
+		}
+
+		slot_t const* _find(colour_t colour) const {
+			if (count == 0) {
+				return nullptr;
+			}
+			for (size_t slot = _get_home_slot(colour);; slot = (slot + 1) & mask) {
+				slot_t const& entry = slots[slot];
+				if (entry.colour == colour) {
+					return &entry;
+				}
+				if (entry.colour == NULL_COLOUR) {
+					return nullptr;
+				}
+			}
+		}
+
+		void _rehash(size_t new_capacity) {
+			std::vector<slot_t> old_slots(new_capacity, { NULL_COLOUR, null_index });
+			old_slots.swap(slots);
+			mask = new_capacity - 1;
+			for (slot_t const& entry : old_slots) {
+				if (entry.colour != NULL_COLOUR) {
+					size_t slot = _get_home_slot(entry.colour);
+					while (slots[slot].colour != NULL_COLOUR) {
+						slot = (slot + 1) & mask;
+					}
+					slots[slot] = entry;
+				}
+			}
+		}
+
+	public:
+		ColourIndexMap(index_t new_null_index = {}) : null_index { new_null_index } {}
+
+		size_t size() const {
+			return count;
+		}
+
+		bool empty() const {
+			return count == 0;
+		}
+
+		void clear() {
+			slots.clear();
+			mask = 0;
+			count = 0;
+		}
+
+		/* Sizes the table so expected_count colours can be added without it growing. */
+		void reserve(size_t expected_count) {
+			const size_t capacity = std::max(MIN_CAPACITY, std::bit_ceil(expected_count * 2));
+			if (capacity > slots.size()) {
+				_rehash(capacity);
+			}
+		}
+
+		/* Returns false without changing anything if colour is NULL_COLOUR or is already in the map. */
+		bool insert(colour_t colour, index_t index) {
+			if (colour == NULL_COLOUR || _find(colour) != nullptr) {
+				return false;
+			}
+			if ((count + 1) * 2 > slots.size()) {
+				_rehash(std::max(MIN_CAPACITY, slots.size() * 2));
+			}
+			size_t slot = _get_home_slot(colour);
+			while (slots[slot].colour != NULL_COLOUR) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = { colour, index };
+			count++;
+			return true;
+		}
+
+		/* Returns the index mapped to colour, or the null index given on construction if there is none. */
+		index_t get_index(colour_t colour) const {
+			slot_t const* entry = _find(colour);
+			return entry != nullptr ? entry->index : null_index;
+		}
+	};
+}
@@ -248,6 +248,18 @@ namespace OpenVic {
 			return index < size();
 		}
 
+		/* The item's position in the registry, so items are densely indexed from 0 to size() - 1 in the order they were
+		 * added. The item must be in the registry. */
+		size_t get_index_of(value_type const& item) const {
+			if constexpr (std::is_same_v<value_type, storage_type>) {
+				return std::addressof(item) - items.data();
+			} else {
+				const typename decltype(identifier_index_map)::const_iterator it =
+					identifier_index_map.find(GetIdentifier(std::addressof(item)));
+				return it != identifier_index_map.end() ? it->second : size();
+			}
+		}
+
 		REF_GETTERS(items)
 
 		std::vector<std::string_view> get_item_identifiers() const {
@@ -333,6 +345,9 @@ namespace OpenVic {
 	size_t get_##singular##_count() const { \
 		return plural.size(); \
 	} \
+	size_t get_##singular##_index(decltype(plural)::value_type const& item) const { \
+		return plural.get_index_of(item); \
+	} \
 	bool plural##_empty() const { \
 		return plural.empty(); \
 	} \
@@ -367,6 +382,9 @@ namespace OpenVic {
 	decltype(plural)::value_type* get_##singular##_by_identifier(std::string_view identifier) { \
 		return plural.get_item_by_identifier(identifier); \
 	} \
+	std::vector<decltype(plural)::storage_type>& get_##plural() { \
+		return plural.get_items(); \
+	} \
 	NodeTools::callback_t<std::string_view> expect_##singular##_str( \
 		NodeTools::callback_t<decltype(plural)::value_type&> callback, bool warn = false \
 	) { \
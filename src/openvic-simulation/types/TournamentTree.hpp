@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+namespace OpenVic {
+	/* Keeps track of the largest of a fixed number of values as they change. The values are the leaves of a complete
+	 * binary tree in which every other node holds the larger of its two children, so the largest value is always at the
+	 * root and changing a value only replays the comparisons on its path to the root, in O(log n) time. Leaves past the
+	 * end hold default constructed values, so T {} must be no larger than any of the real values. */
+	template<typename T>
+	struct TournamentTree {
+		using value_t = T;
+
+	private:
+		/* nodes[1] is the root, the children of nodes[i] are nodes[2 * i] and nodes[2 * i + 1], and the leaves start at
+		 * nodes[leaf_count]. nodes[0] is unused. */
+		std::vector<T> nodes;
+		size_t leaf_count = 0, size = 0;
+
+	public:
+		/* Resizes the tree to hold new_size values, all T {}. */
+		void reset(size_t new_size) {
+			size = new_size;
+			leaf_count = std::bit_ceil(std::max<size_t>(new_size, 1));
+			nodes.assign(leaf_count * 2, T {});
+		}
+
+		size_t get_size() const {
+			return size;
+		}
+
+		T const& get(size_t index) const {
+			return nodes[leaf_count + index];
+		}
+
+		void set(size_t index, T const& value) {
+			size_t node = leaf_count + index;
+			nodes[node] = value;
+			for (node /= 2; node > 0; node /= 2) {
+				T const& winner = std::max(nodes[node * 2], nodes[node * 2 + 1]);
+				/* Nothing above this node can change if it already holds the winner. */
+				if (nodes[node] == winner) {
+					break;
+				}
+				nodes[node] = winner;
+			}
+		}
+
+		T get_max() const {
+			return !nodes.empty() ? nodes[1] : T {};
+		}
+
+		/* The index of the first of the largest values, only valid if the tree holds any values. */
+		size_t get_max_index() const {
+			size_t node = 1;
+			while (node < leaf_count) {
+				node = nodes[node * 2] == nodes[node] ? node * 2 : node * 2 + 1;
+			}
+			return node - leaf_count;
+		}
+	};
+}
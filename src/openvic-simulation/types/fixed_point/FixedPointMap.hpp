@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <map>
+#include <span>
+#include <vector>
+
 #include "openvic-simulation/types/fixed_point/FixedPoint.hpp"
 
 namespace OpenVic {
@@ -45,4 +50,73 @@ namespace OpenVic {
 		}
 		return std::make_pair(std::move(largest), std::move(second_largest));
 	}
+
+	/* A fixed_point_map_t for keys which are the items of a value registry, stored as a flat array of values indexed by
+	 * each item's position in the registry. Refilling it allocates nothing once it has the registry's size, and the
+	 * queries below are linear scans over contiguous values. Keys with a value of 0 count as not being in the map. */
+	template<typename T>
+	struct IndexedFixedPointMap {
+		using key_t = T;
+
+	private:
+		std::span<const T> keys;
+		std::vector<fixed_point_t> PROPERTY(values);
+
+	public:
+		/* Sets every key's value to 0, reusing the existing storage if the keys have not grown. */
+		void reset(std::span<const T> new_keys) {
+			keys = new_keys;
+			values.assign(keys.size(), 0);
+		}
+
+		size_t size() const {
+			return values.size();
+		}
+
+		T const& get_key(size_t index) const {
+			return keys[index];
+		}
+
+		fixed_point_t& operator[](size_t index) {
+			return values[index];
+		}
+
+		fixed_point_t operator[](size_t index) const {
+			return values[index];
+		}
+
+		/* The key must be one of the map's keys. */
+		fixed_point_t get_value(T const& key) const {
+			return values[&key - keys.data()];
+		}
+	};
+
+	template<typename T>
+	constexpr fixed_point_t get_total(IndexedFixedPointMap<T> const& map) {
+		fixed_point_t total = 0;
+		for (fixed_point_t const& value : map.get_values()) {
+			total += value;
+		}
+		return total;
+	}
+
+	/* The indices of the largest and second largest values, or map.size() where there are not enough values above 0. */
+	template<typename T>
+	constexpr std::pair<size_t, size_t> get_largest_two_items(IndexedFixedPointMap<T> const& map) {
+		std::span<const fixed_point_t> values = map.get_values();
+		size_t largest = values.size(), second_largest = values.size();
+		fixed_point_t largest_value = 0, second_largest_value = 0;
+		for (size_t index = 0; index < values.size(); ++index) {
+			if (values[index] > largest_value) {
+				second_largest = largest;
+				second_largest_value = largest_value;
+				largest = index;
+				largest_value = values[index];
+			} else if (values[index] > second_largest_value) {
+				second_largest = index;
+				second_largest_value = values[index];
+			}
+		}
+		return std::make_pair(largest, second_largest);
+	}
 }
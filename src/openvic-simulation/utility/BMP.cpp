@@ -1,6 +1,7 @@
 #include "BMP.hpp"
 
 #include <cstring>
+#include <limits>
 #include <set>
 
 #include "openvic-simulation/utility/Logger.hpp"
@@ -11,8 +12,15 @@ BMP::~BMP() {
 	close();
 }
 
-bool BMP::open(fs::path const& filepath) {
+bool BMP::open(fs::path const& filepath, bool memory_map) {
 	reset();
+	if (memory_map) {
+		if (!mapped_file.open(filepath)) {
+			Logger::error("Failed to map BMP file \"", filepath, "\"");
+			return false;
+		}
+		return true;
+	}
 	file.open(filepath, std::ios::binary);
 	if (file.fail()) {
 		Logger::error("Failed to open BMP file \"", filepath, "\"");
@@ -22,23 +30,43 @@ bool BMP::open(fs::path const& filepath) {
 	return true;
 }
 
+bool BMP::_is_open() const {
+	return file.is_open() || mapped_file.is_open();
+}
+
+bool BMP::_read_bytes(size_t offset, void* destination, size_t size, std::string_view description) {
+	if (mapped_file.is_open()) {
+		const std::span<const uint8_t> data = mapped_file.get_data();
+		if (offset > data.size() || size > data.size() - offset) {
+			Logger::error("Failed to read BMP ", description, " - file is too short!");
+			return false;
+		}
+		std::memcpy(destination, data.data() + offset, size);
+		return true;
+	}
+	file.seekg(offset, std::ios::beg);
+	if (file.fail()) {
+		Logger::error("Failed to move to the ", description, " in the BMP file!");
+		return false;
+	}
+	file.read(reinterpret_cast<char*>(destination), size);
+	if (file.fail()) {
+		Logger::error("Failed to read BMP ", description, "!");
+		return false;
+	}
+	return true;
+}
+
 bool BMP::read_header() {
 	if (header_validated) {
 		Logger::error("BMP header already validated!");
 		return false;
 	}
-	if (!file.is_open()) {
+	if (!_is_open()) {
 		Logger::error("Cannot read BMP header before opening a file");
 		return false;
 	}
-	file.seekg(0, std::ios::beg);
-	if (file.fail()) {
-		Logger::error("Failed to move to the beginning of the BMP file!");
-		return false;
-	}
-	file.read(reinterpret_cast<char*>(&header), sizeof(header));
-	if (file.fail()) {
-		Logger::error("Failed to read BMP header!");
+	if (!_read_bytes(0, &header, sizeof(header), "header")) {
 		return false;
 	}
 
@@ -80,11 +108,12 @@ bool BMP::read_header() {
 		Logger::error("Invalid BMP width: ", header.width_px, " (must be positive)");
 		header_validated = false;
 	}
-	// TODO - support negative heights (i.e. vertical flip)
-	if (header.height_px <= 0) {
-		Logger::error("Invalid BMP height: ", header.height_px, " (must be positive)");
+	// Negative heights mean rows are stored top-down rather than bottom-up
+	if (header.height_px == 0 || header.height_px == std::numeric_limits<int32_t>::min()) {
+		Logger::error("Invalid BMP height: ", header.height_px, " (must be non-zero)");
 		header_validated = false;
 	}
+	top_down = header.height_px < 0;
 	// TODO - validate x_resolution_ppm
 	// TODO - validate y_resolution_ppm
 
@@ -113,6 +142,9 @@ bool BMP::read_header() {
 		: (0 < header.num_colours && header.num_colours - 1 >> header.bits_per_pixel == 0
 		? header.num_colours : 1 << header.bits_per_pixel);
 
+	// Rows are padded to a multiple of 4 bytes
+	row_stride = (static_cast<size_t>(get_width()) * header.bits_per_pixel + 31) / 32 * 4;
+
 	const uint32_t expected_offset = palette_size * PALETTE_COLOUR_SIZE + sizeof(header);
 	if (header.offset != expected_offset) {
 		Logger::error("Invalid BMP image data offset: ", header.offset, " (should be ", expected_offset, ")");
@@ -127,7 +159,7 @@ bool BMP::read_palette() {
 		Logger::error("BMP palette already read!");
 		return false;
 	}
-	if (!file.is_open()) {
+	if (!_is_open()) {
 		Logger::error("Cannot read BMP palette before opening a file");
 		return false;
 	}
@@ -139,15 +171,8 @@ bool BMP::read_palette() {
 		Logger::error("Cannot read BMP palette - header indicates this file doesn't have one");
 		return false;
 	}
-	file.seekg(sizeof(header), std::ios::beg);
-	if (file.fail()) {
-		Logger::error("Failed to move to the palette in the BMP file!");
-		return false;
-	}
 	palette.resize(palette_size);
-	file.read(reinterpret_cast<char*>(palette.data()), palette_size * PALETTE_COLOUR_SIZE);
-	if (file.fail()) {
-		Logger::error("Failed to read BMP header!");
+	if (!_read_bytes(sizeof(header), palette.data(), palette_size * PALETTE_COLOUR_SIZE, "palette")) {
 		palette.clear();
 		return false;
 	}
@@ -163,11 +188,17 @@ void BMP::close() {
 
 void BMP::reset() {
 	close();
+	mapped_file.close();
 	memset(&header, 0, sizeof(header));
 	header_validated = false;
+	palette_read = false;
+	pixel_data_read = false;
+	top_down = false;
 	palette_size = 0;
+	row_stride = 0;
 	palette.clear();
-	pixel_data.clear();
+	pixel_buffer.clear();
+	pixel_data = {};
 }
 
 int32_t BMP::get_width() const {
@@ -175,13 +206,21 @@ int32_t BMP::get_width() const {
 }
 
 int32_t BMP::get_height() const {
-	return header.height_px;
+	return top_down ? -header.height_px : header.height_px;
 }
 
 uint16_t BMP::get_bits_per_pixel() const {
 	return header.bits_per_pixel;
 }
 
+bool BMP::is_top_down() const {
+	return top_down;
+}
+
+size_t BMP::get_row_stride() const {
+	return row_stride;
+}
+
 std::vector<colour_t> const& BMP::get_palette() const {
 	if (!palette_read) {
 		Logger::warning("Trying to get BMP palette before loading");
@@ -194,7 +233,7 @@ bool BMP::read_pixel_data() {
 		Logger::error("BMP pixel data already read!");
 		return false;
 	}
-	if (!file.is_open()) {
+	if (!_is_open()) {
 		Logger::error("Cannot read BMP pixel data before opening a file");
 		return false;
 	}
@@ -202,26 +241,37 @@ bool BMP::read_pixel_data() {
 		Logger::error("Cannot read pixel data before BMP header is validated!");
 		return false;
 	}
-	file.seekg(header.offset, std::ios::beg);
-	if (file.fail()) {
-		Logger::error("Failed to move to the pixel data in the BMP file!");
-		return false;
-	}
-	const size_t pixel_data_size = get_width() * get_height() * header.bits_per_pixel / 8;
-	pixel_data.resize(pixel_data_size);
-	file.read(reinterpret_cast<char*>(pixel_data.data()), pixel_data_size);
-	if (file.fail()) {
-		Logger::error("Failed to read BMP pixel data!");
-		pixel_data.clear();
-		return false;
+	const size_t pixel_data_size = row_stride * get_height();
+	if (mapped_file.is_open()) {
+		const std::span<const uint8_t> data = mapped_file.get_data();
+		if (header.offset > data.size() || pixel_data_size > data.size() - header.offset) {
+			Logger::error(
+				"Failed to read BMP pixel data - file is ", data.size(), " bytes, expected at least ",
+				header.offset + pixel_data_size
+			);
+			return false;
+		}
+		pixel_data = data.subspan(header.offset, pixel_data_size);
+	} else {
+		pixel_buffer.resize(pixel_data_size);
+		if (!_read_bytes(header.offset, pixel_buffer.data(), pixel_data_size, "pixel data")) {
+			pixel_buffer.clear();
+			return false;
+		}
+		pixel_data = pixel_buffer;
 	}
 	pixel_data_read = true;
 	return pixel_data_read;
 }
 
-std::vector<uint8_t> const& BMP::get_pixel_data() const {
+std::span<const uint8_t> BMP::get_pixel_data() const {
 	if (!pixel_data_read) {
 		Logger::warning("Trying to get BMP pixel data before loading");
 	}
 	return pixel_data;
 }
+
+uint8_t const* BMP::get_pixel_row(size_t y) const {
+	const size_t row = top_down ? get_height() - 1 - y : y;
+	return pixel_data.data() + row * row_stride;
+}
@@ -2,9 +2,12 @@
 
 #include <filesystem>
 #include <fstream>
+#include <span>
+#include <string_view>
 #include <vector>
 
 #include "openvic-simulation/types/Colour.hpp"
+#include "openvic-simulation/utility/MappedFile.hpp"
 
 namespace OpenVic {
 	namespace fs = std::filesystem;
@@ -33,10 +36,18 @@ namespace OpenVic {
 #pragma pack(pop)
 
 		std::ifstream file;
-		bool header_validated = false, palette_read = false, pixel_data_read = false;
+		/* Used instead of file when opened in memory-mapped mode. */
+		MappedFile mapped_file;
+		bool header_validated = false, palette_read = false, pixel_data_read = false, top_down = false;
 		uint32_t palette_size = 0;
+		size_t row_stride = 0;
 		std::vector<colour_t> palette;
-		std::vector<uint8_t> pixel_data;
+		/* Only used when not memory-mapped, otherwise pixel_data points straight into the mapped file. */
+		std::vector<uint8_t> pixel_buffer;
+		std::span<const uint8_t> pixel_data;
+
+		bool _is_open() const;
+		bool _read_bytes(size_t offset, void* destination, size_t size, std::string_view description);
 
 	public:
 		static constexpr uint32_t PALETTE_COLOUR_SIZE = sizeof(colour_t);
@@ -44,7 +55,10 @@ namespace OpenVic {
 		BMP() = default;
 		~BMP();
 
-		bool open(fs::path const& filepath);
+		/* If memory_map is set, the file is mapped rather than read through a stream, and the pixel data is a view of
+		 * the mapping rather than a copy. The view stays valid until the BMP is reset, reopened or destroyed, even
+		 * after close is called. */
+		bool open(fs::path const& filepath, bool memory_map = false);
 		bool read_header();
 		bool read_palette();
 		bool read_pixel_data();
@@ -52,9 +66,17 @@ namespace OpenVic {
 		void reset();
 
 		int32_t get_width() const;
+		/* Always positive, even for top-down images which have a negative height in their header. */
 		int32_t get_height() const;
 		uint16_t get_bits_per_pixel() const;
+		bool is_top_down() const;
+		/* Bytes per row of pixel data, including the padding to a multiple of 4 bytes. */
+		size_t get_row_stride() const;
 		std::vector<colour_t> const& get_palette() const;
-		std::vector<uint8_t> const& get_pixel_data() const;
+		/* Rows of pixel data as stored in the file, each get_row_stride() bytes long. */
+		std::span<const uint8_t> get_pixel_data() const;
+		/* Rows are numbered bottom-up, matching the storage order of standard BMPs and the map's coordinate system, so
+		 * y = 0 is the bottom row whichever order the file stores its rows in. */
+		uint8_t const* get_pixel_row(size_t y) const;
 	};
 }
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "openvic-simulation/utility/Getters.hpp"
+#include "openvic-simulation/utility/Logger.hpp"
+
+namespace OpenVic {
+	/* Minimal binary serialisation helpers. Values are copied byte for byte in native byte order and layout, so the
+	 * data is only meant to be read back by the same build on the same platform, e.g. for in-memory snapshots.
+	 * Registry items are written as their index in the registry's item vector rather than by identifier. */
+	struct BinaryWriter {
+		using index_t = uint32_t;
+
+		static constexpr index_t NULL_INDEX = std::numeric_limits<index_t>::max();
+
+	private:
+		std::vector<uint8_t>& buffer;
+
+	public:
+		BinaryWriter(std::vector<uint8_t>& new_buffer) : buffer { new_buffer } {}
+
+		void write_bytes(void const* data, size_t size) {
+			const size_t offset = buffer.size();
+			buffer.resize(offset + size);
+			std::memcpy(buffer.data() + offset, data, size);
+		}
+
+		template<typename T>
+		requires std::is_trivially_copyable_v<T>
+		void write(T const& value) {
+			write_bytes(&value, sizeof(T));
+		}
+
+		/* item must either be null or point to an element of items. */
+		template<typename T>
+		void write_index(std::vector<T> const& items, T const* item) {
+			write<index_t>(item != nullptr ? static_cast<index_t>(item - items.data()) : NULL_INDEX);
+		}
+	};
+
+	struct BinaryReader {
+		using index_t = BinaryWriter::index_t;
+
+		static constexpr index_t NULL_INDEX = BinaryWriter::NULL_INDEX;
+
+	private:
+		std::span<const uint8_t> data;
+		size_t PROPERTY(offset);
+
+	public:
+		BinaryReader(std::span<const uint8_t> new_data) : data { new_data }, offset { 0 } {}
+
+		bool at_end() const {
+			return offset == data.size();
+		}
+
+		size_t get_remaining() const {
+			return data.size() - offset;
+		}
+
+		bool read_bytes(void* destination, size_t size) {
+			if (size > data.size() - offset) {
+				Logger::error("Unexpected end of binary data reading ", size, " bytes at offset ", offset, " of ", data.size());
+				return false;
+			}
+			std::memcpy(destination, data.data() + offset, size);
+			offset += size;
+			return true;
+		}
+
+		/* Bools and enums have to be read with read_bool and read_enum, so invalid values are rejected rather than
+		 * copied into them. */
+		template<typename T>
+		requires std::is_trivially_copyable_v<T> && (!std::is_same_v<T, bool>) && (!std::is_enum_v<T>)
+		bool read(T& value) {
+			return read_bytes(&value, sizeof(T));
+		}
+
+		bool read_bool(bool& value) {
+			static_assert(sizeof(bool) == sizeof(uint8_t));
+			uint8_t raw;
+			if (!read(raw)) {
+				return false;
+			}
+			if (raw > 1) {
+				Logger::error("Invalid bool value ", static_cast<uint32_t>(raw), " in binary data at offset ", offset - 1);
+				return false;
+			}
+			value = raw != 0;
+			return true;
+		}
+
+		/* Fails on values outside the range from 0 to last. */
+		template<typename T>
+		requires std::is_enum_v<T>
+		bool read_enum(T& value, T last) {
+			using underlying_t = std::underlying_type_t<T>;
+			underlying_t raw;
+			if (!read(raw)) {
+				return false;
+			}
+			if (std::cmp_less(raw, 0) || std::cmp_greater(raw, static_cast<underlying_t>(last))) {
+				Logger::error(
+					"Invalid enum value ", static_cast<int64_t>(raw), " in binary data at offset ",
+					offset - sizeof(underlying_t)
+				);
+				return false;
+			}
+			value = static_cast<T>(raw);
+			return true;
+		}
+
+		template<typename T>
+		bool read_index(std::vector<T> const& items, T const*& item) {
+			index_t index;
+			if (!read(index)) {
+				return false;
+			}
+			if (index == NULL_INDEX) {
+				item = nullptr;
+				return true;
+			}
+			if (index >= items.size()) {
+				Logger::error("Invalid registry index ", index, " in binary data, there are only ", items.size(), " items");
+				return false;
+			}
+			item = &items[index];
+			return true;
+		}
+
+		/* As read_index, but fails on a null index. */
+		template<typename T>
+		bool read_non_null_index(std::vector<T> const& items, T const*& item) {
+			if (!read_index(items, item)) {
+				return false;
+			}
+			if (item == nullptr) {
+				Logger::error("Unexpected null registry index in binary data at offset ", offset - sizeof(index_t));
+				return false;
+			}
+			return true;
+		}
+	};
+}
@@ -0,0 +1,111 @@
+#include "MappedFile.hpp"
+
+#include <system_error>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "openvic-simulation/utility/Logger.hpp"
+
+using namespace OpenVic;
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(fs::path const& filepath) {
+	close();
+
+	std::error_code error_code;
+	const uintmax_t file_size = fs::file_size(filepath, error_code);
+	if (error_code) {
+		Logger::error("Failed to get size of file to map \"", filepath, "\": ", error_code.message());
+		return false;
+	}
+	if (file_size == 0) {
+		opened = true;
+		return true;
+	}
+	if (file_size > SIZE_MAX) {
+		Logger::error("File \"", filepath, "\" is too large to map: ", file_size, " bytes");
+		return false;
+	}
+
+#if defined(_WIN32)
+	file_handle = CreateFileW(
+		filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+	);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		Logger::error("Failed to open file to map \"", filepath, "\"");
+		return false;
+	}
+	mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle == nullptr) {
+		Logger::error("Failed to create mapping of file \"", filepath, "\"");
+		close();
+		return false;
+	}
+	void const* mapped = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (mapped == nullptr) {
+		Logger::error("Failed to map view of file \"", filepath, "\"");
+		close();
+		return false;
+	}
+#else
+	const int file_descriptor = ::open(filepath.c_str(), O_RDONLY);
+	if (file_descriptor == -1) {
+		Logger::error("Failed to open file to map \"", filepath, "\"");
+		return false;
+	}
+	void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	/* The mapping keeps its own reference to the file. */
+	::close(file_descriptor);
+	if (mapped == MAP_FAILED) {
+		Logger::error("Failed to map file \"", filepath, "\"");
+		return false;
+	}
+#endif
+
+	data = { static_cast<uint8_t const*>(mapped), static_cast<size_t>(file_size) };
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+#if defined(_WIN32)
+	if (!data.empty()) {
+		UnmapViewOfFile(data.data());
+	}
+	if (mapping_handle != nullptr) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	if (file_handle != nullptr) {
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+#else
+	if (!data.empty()) {
+		munmap(const_cast<uint8_t*>(data.data()), data.size());
+	}
+#endif
+	data = {};
+	opened = false;
+}
+
+bool MappedFile::is_open() const {
+	return opened;
+}
+
+std::span<const uint8_t> MappedFile::get_data() const {
+	return data;
+}
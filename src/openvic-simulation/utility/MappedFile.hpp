@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace OpenVic {
+	namespace fs = std::filesystem;
+
+	/* Read-only memory mapping of a whole file, letting its contents be used in place rather than copied into memory.
+	 * Pages are only read from disk when first touched and are shared with the OS file cache, so mapping the same file
+	 * from several processes or repeated runs costs little more than mapping it once. */
+	class MappedFile {
+		std::span<const uint8_t> data;
+		bool opened = false;
+#if defined(_WIN32)
+		void* file_handle = nullptr;
+		void* mapping_handle = nullptr;
+#endif
+
+	public:
+		MappedFile() = default;
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+		~MappedFile();
+
+		/* Closes any previously mapped file first. An empty file opens successfully with empty data. */
+		bool open(fs::path const& filepath);
+		/* Unmaps the file, invalidating any pointers into its data. */
+		void close();
+
+		bool is_open() const;
+		std::span<const uint8_t> get_data() const;
+	};
+}
@@ -0,0 +1,124 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "openvic-simulation/utility/Logger.hpp"
+
+using namespace OpenVic;
+
+size_t Profiler::_get_thread_index() {
+	return thread_indices.emplace(std::this_thread::get_id(), thread_indices.size()).first->second;
+}
+
+void Profiler::record_sample(std::string_view phase_name, clock_t::time_point start, clock_t::time_point end) {
+	const int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count();
+	const int64_t duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	const std::lock_guard<std::mutex> lock { mutex };
+	phase_t& phase = phases[phase_name];
+	if (phase.call_count == 0 || duration_ns < phase.min_ns) {
+		phase.min_ns = duration_ns;
+	}
+	phase.call_count++;
+	phase.total_ns += duration_ns;
+	if (phase.reservoir.size() < MAX_RESERVOIR_SAMPLES) {
+		phase.reservoir.push_back(duration_ns);
+	} else {
+		/* Reservoir sampling keeps every sample equally likely to be retained. */
+		phase.reservoir_rng ^= phase.reservoir_rng << 13;
+		phase.reservoir_rng ^= phase.reservoir_rng >> 7;
+		phase.reservoir_rng ^= phase.reservoir_rng << 17;
+		const uint64_t slot = phase.reservoir_rng % phase.call_count;
+		if (slot < MAX_RESERVOIR_SAMPLES) {
+			phase.reservoir[slot] = duration_ns;
+		}
+	}
+	if (trace_events.size() < MAX_TRACE_EVENTS) {
+		trace_events.push_back({ phase_name, _get_thread_index(), start_ns, duration_ns });
+	}
+}
+
+void Profiler::add_to_counter(std::string_view counter_name, int64_t amount) {
+	const int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - epoch).count();
+
+	const std::lock_guard<std::mutex> lock { mutex };
+	int64_t& value = counters[counter_name];
+	value += amount;
+	if (counter_samples.size() < MAX_TRACE_EVENTS) {
+		counter_samples.push_back({ counter_name, time_ns, value });
+	}
+}
+
+std::vector<Profiler::phase_stats_t> Profiler::get_phase_stats() {
+	static constexpr double NS_PER_MS = 1000000.0;
+
+	const std::lock_guard<std::mutex> lock { mutex };
+	std::vector<phase_stats_t> stats;
+	stats.reserve(phases.size());
+	for (auto const& [name, phase] : phases) {
+		std::vector<int64_t> samples = phase.reservoir;
+		int64_t p99_ns = 0;
+		if (!samples.empty()) {
+			const size_t p99_index = std::min(samples.size() - 1, samples.size() * 99 / 100);
+			std::nth_element(samples.begin(), samples.begin() + p99_index, samples.end());
+			p99_ns = samples[p99_index];
+		}
+		stats.push_back({
+			std::string { name }, phase.call_count, phase.total_ns / NS_PER_MS, phase.min_ns / NS_PER_MS,
+			phase.call_count > 0 ? phase.total_ns / NS_PER_MS / phase.call_count : 0.0, p99_ns / NS_PER_MS
+		});
+	}
+	return stats;
+}
+
+std::map<std::string, int64_t> Profiler::get_counters() {
+	const std::lock_guard<std::mutex> lock { mutex };
+	return { counters.begin(), counters.end() };
+}
+
+bool Profiler::write_chrome_trace(fs::path const& path) {
+	std::ofstream file { path };
+	if (file.fail()) {
+		Logger::error("Failed to open profiler trace file \"", path, "\"");
+		return false;
+	}
+
+	const std::lock_guard<std::mutex> lock { mutex };
+	/* Trace event timestamps and durations are in microseconds. */
+	const auto write_us = [&file](int64_t ns) -> void {
+		file << ns / 1000 << '.' << (ns % 1000) / 100 << (ns % 100) / 10 << ns % 10;
+	};
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (trace_event_t const& event : trace_events) {
+		file << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"openvic\",\"ph\":\"X\",\"pid\":0,"
+			<< "\"tid\":" << event.thread << ",\"ts\":";
+		write_us(event.start_ns);
+		file << ",\"dur\":";
+		write_us(event.duration_ns);
+		file << "}";
+		first = false;
+	}
+	for (counter_sample_t const& sample : counter_samples) {
+		file << (first ? "\n" : ",\n") << "{\"name\":\"" << sample.name << "\",\"ph\":\"C\",\"pid\":0,\"ts\":";
+		write_us(sample.time_ns);
+		file << ",\"args\":{\"value\":" << sample.value << "}}";
+		first = false;
+	}
+	file << "\n]}\n";
+	if (file.fail()) {
+		Logger::error("Failed to write profiler trace file \"", path, "\"");
+		return false;
+	}
+	return true;
+}
+
+void Profiler::reset() {
+	const std::lock_guard<std::mutex> lock { mutex };
+	phases.clear();
+	counters.clear();
+	trace_events.clear();
+	counter_samples.clear();
+	thread_indices.clear();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace OpenVic {
+	namespace fs = std::filesystem;
+
+	/* Lightweight instrumentation for finding where simulation time goes. Timings are collected through the
+	 * OV_PROFILE_SCOPE and OV_PROFILE_COUNTER macros below, which compile to nothing unless OPENVIC_SIM_PROFILING is
+	 * defined, so instrumented code costs nothing in normal builds. All functions are thread safe. */
+	class Profiler final {
+	public:
+		using clock_t = std::chrono::steady_clock;
+
+		struct phase_stats_t {
+			std::string name;
+			size_t call_count;
+			double total_ms;
+			double min_ms;
+			double mean_ms;
+			double p99_ms;
+		};
+
+		/* Records its lifetime as a sample of the named phase. The name must outlive the profiler's data,
+		 * which in practice means it should be a string literal. */
+		class ScopedTimer {
+			std::string_view name;
+			clock_t::time_point start;
+
+		public:
+			ScopedTimer(std::string_view new_name) : name { new_name }, start { clock_t::now() } {}
+			ScopedTimer(ScopedTimer const&) = delete;
+			ScopedTimer& operator=(ScopedTimer const&) = delete;
+			~ScopedTimer() {
+				record_sample(name, start, clock_t::now());
+			}
+		};
+
+	private:
+		/* Percentiles are taken from a bounded reservoir of samples so long runs don't grow memory without limit. */
+		static constexpr size_t MAX_RESERVOIR_SAMPLES = 1 << 16;
+		/* Trace events stop being recorded after this many, though phase statistics keep being gathered. */
+		static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+		struct phase_t {
+			size_t call_count = 0;
+			int64_t total_ns = 0;
+			int64_t min_ns = 0;
+			std::vector<int64_t> reservoir;
+			uint64_t reservoir_rng = 0x9E3779B97F4A7C15;
+		};
+
+		struct trace_event_t {
+			std::string_view name;
+			size_t thread;
+			int64_t start_ns;
+			int64_t duration_ns;
+		};
+
+		struct counter_sample_t {
+			std::string_view name;
+			int64_t time_ns;
+			int64_t value;
+		};
+
+		static inline std::mutex mutex;
+		static inline const clock_t::time_point epoch = clock_t::now();
+		static inline std::map<std::string_view, phase_t, std::less<>> phases;
+		static inline std::map<std::string_view, int64_t, std::less<>> counters;
+		static inline std::vector<trace_event_t> trace_events;
+		static inline std::vector<counter_sample_t> counter_samples;
+		static inline std::map<std::thread::id, size_t> thread_indices;
+
+		static size_t _get_thread_index();
+
+	public:
+		static void record_sample(std::string_view phase, clock_t::time_point start, clock_t::time_point end);
+		static void add_to_counter(std::string_view counter, int64_t amount);
+
+		/* Phases are returned sorted by name. */
+		static std::vector<phase_stats_t> get_phase_stats();
+		static std::map<std::string, int64_t> get_counters();
+		/* Writes everything recorded so far in the Chrome trace event JSON format, which can be opened in
+		 * chrome://tracing, Perfetto or Speedscope. */
+		static bool write_chrome_trace(fs::path const& path);
+		static void reset();
+	};
+}
+
+#define OV_PROFILE_CONCAT_DETAIL(a, b) a##b
+#define OV_PROFILE_CONCAT(a, b) OV_PROFILE_CONCAT_DETAIL(a, b)
+
+#ifdef OPENVIC_SIM_PROFILING
+#define OV_PROFILE_SCOPE(name) const OpenVic::Profiler::ScopedTimer OV_PROFILE_CONCAT(_ov_profile_timer_, __LINE__) { name }
+#define OV_PROFILE_COUNTER(name, amount) OpenVic::Profiler::add_to_counter(name, amount)
+#else
+#define OV_PROFILE_SCOPE(name) ((void)0)
+#define OV_PROFILE_COUNTER(name, amount) ((void)0)
+#endif
@@ -0,0 +1,167 @@
+#include "ThreadPool.hpp"
+
+#include "openvic-simulation/utility/Logger.hpp"
+
+using namespace OpenVic;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	_start(thread_count);
+}
+
+ThreadPool::~ThreadPool() {
+	_stop();
+}
+
+size_t ThreadPool::get_hardware_thread_count() {
+	const size_t count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void ThreadPool::_start(size_t thread_count) {
+	stopping = false;
+	queues.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i) {
+		queues.push_back(std::make_unique<worker_queue_t>());
+	}
+	workers.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i) {
+		workers.emplace_back(&ThreadPool::_worker_loop, this, i);
+	}
+}
+
+void ThreadPool::_stop() {
+	{
+		const std::lock_guard<std::mutex> lock { wake_mutex };
+		stopping = true;
+	}
+	wake_condition.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	queues.clear();
+	queued_task_count = 0;
+}
+
+void ThreadPool::set_thread_count(size_t thread_count) {
+	if (thread_count == workers.size()) {
+		return;
+	}
+	_stop();
+	_start(thread_count);
+	Logger::info("Thread pool running with ", thread_count, " worker thread(s)");
+}
+
+size_t ThreadPool::get_thread_count() const {
+	return workers.size();
+}
+
+bool ThreadPool::is_parallel() const {
+	return !workers.empty();
+}
+
+bool ThreadPool::_pop_task(size_t preferred_queue, task_t& task) {
+	const size_t queue_count = queues.size();
+	for (size_t offset = 0; offset < queue_count; ++offset) {
+		worker_queue_t& queue = *queues[(preferred_queue + offset) % queue_count];
+		const std::lock_guard<std::mutex> lock { queue.mutex };
+		if (!queue.tasks.empty()) {
+			/* Owners take from the front, thieves from the back, so they rarely contend for the same chunk. */
+			if (offset == 0) {
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			} else {
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			queued_task_count--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::_push_task(task_t&& task) {
+	worker_queue_t& queue = *queues[next_queue++ % queues.size()];
+	/* Counted before the task becomes visible, so a thief popping it straight away can never take the count below 0. */
+	{
+		const std::lock_guard<std::mutex> lock { wake_mutex };
+		queued_task_count++;
+	}
+	{
+		const std::lock_guard<std::mutex> lock { queue.mutex };
+		queue.tasks.push_back(std::move(task));
+	}
+	wake_condition.notify_one();
+}
+
+void ThreadPool::_worker_loop(size_t queue_index) {
+	task_t task;
+	while (true) {
+		if (_pop_task(queue_index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock { wake_mutex };
+		wake_condition.wait(lock, [this]() -> bool {
+			return stopping || queued_task_count > 0;
+		});
+		if (stopping) {
+			return;
+		}
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, size_t chunk_size, range_func_t const& func) {
+	if (count == 0) {
+		return;
+	}
+	if (chunk_size == 0) {
+		chunk_size = 1;
+	}
+	if (workers.empty() || count <= chunk_size) {
+		func(0, count);
+		return;
+	}
+
+	batch_t batch;
+	batch.remaining_chunks = (count + chunk_size - 1) / chunk_size;
+	for (size_t begin = 0; begin < count; begin += chunk_size) {
+		const size_t end = std::min(begin + chunk_size, count);
+		/* Chunks never throw out of their task, so neither workers nor a thread helping with another batch can be
+		 * unwound while this batch still has chunks referring to it. */
+		_push_task([&func, &batch, begin, end]() -> void {
+			std::exception_ptr exception;
+			try {
+				func(begin, end);
+			} catch (...) {
+				exception = std::current_exception();
+			}
+			/* Notified under the lock, as the batch is destroyed as soon as the calling thread sees the last chunk done. */
+			const std::lock_guard<std::mutex> lock { batch.mutex };
+			if (exception && !batch.exception) {
+				batch.exception = exception;
+			}
+			if (--batch.remaining_chunks == 0) {
+				batch.finished_condition.notify_all();
+			}
+		});
+	}
+
+	/* Help out rather than block, which also keeps nested parallel_for calls from starving the pool, then sleep until
+	 * the chunks still running on other threads are done. */
+	const size_t home_queue = next_queue % queues.size();
+	task_t task;
+	while (_pop_task(home_queue, task)) {
+		task();
+		task = nullptr;
+	}
+	std::unique_lock<std::mutex> lock { batch.mutex };
+	batch.finished_condition.wait(lock, [&batch]() -> bool {
+		return batch.remaining_chunks == 0;
+	});
+	if (batch.exception) {
+		std::rethrow_exception(batch.exception);
+	}
+}
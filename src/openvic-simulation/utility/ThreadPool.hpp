@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace OpenVic {
+	/* Work-stealing task pool. Each worker owns a deque which it pops from the front of, and idle workers steal from the
+	 * back of other workers' deques. The thread submitting a batch of work also helps execute it, so nested batches cannot
+	 * deadlock and a pool with no workers simply runs everything serially on the calling thread. */
+	class ThreadPool {
+	public:
+		using task_t = std::function<void()>;
+		/* Args: range begin, range end */
+		using range_func_t = std::function<void(size_t, size_t)>;
+
+	private:
+		struct worker_queue_t {
+			std::mutex mutex;
+			std::deque<task_t> tasks;
+		};
+
+		/* Completion state of one parallel_for call, which the calling thread sleeps on once it has run out of chunks to
+		 * help with. The first exception thrown by a chunk is kept and rethrown by the calling thread. */
+		struct batch_t {
+			std::mutex mutex;
+			std::condition_variable finished_condition;
+			size_t remaining_chunks;
+			std::exception_ptr exception;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<std::unique_ptr<worker_queue_t>> queues;
+		std::mutex wake_mutex;
+		std::condition_variable wake_condition;
+		std::atomic<size_t> queued_task_count = 0;
+		std::atomic<size_t> next_queue = 0;
+		bool stopping = false;
+
+		bool _pop_task(size_t preferred_queue, task_t& task);
+		void _push_task(task_t&& task);
+		void _worker_loop(size_t queue_index);
+		void _start(size_t thread_count);
+		void _stop();
+
+	public:
+		/* A thread count of zero disables the workers, making all batches run serially on the calling thread. */
+		ThreadPool(size_t thread_count = 0);
+		ThreadPool(ThreadPool const&) = delete;
+		ThreadPool& operator=(ThreadPool const&) = delete;
+		~ThreadPool();
+
+		static size_t get_hardware_thread_count();
+
+		void set_thread_count(size_t thread_count);
+		size_t get_thread_count() const;
+		bool is_parallel() const;
+
+		/* Splits [0, count) into chunks of at most chunk_size elements and runs func on each of them, returning once every
+		 * chunk has been processed. Chunks may run in any order and on any thread, so func must only touch data owned by
+		 * the elements of its range. If func throws, the remaining chunks still run and the first exception is rethrown
+		 * once they have all finished. */
+		void parallel_for(size_t count, size_t chunk_size, range_func_t const& func);
+
+		/* Runs map_func on each chunk of [0, count), then combines the chunk results with reduce_func in chunk order,
+		 * starting from identity. As the combination order depends only on count and chunk_size, the result is identical
+		 * to a serial pass with the same chunking regardless of the number of threads. */
+		template<typename T, typename MapFunc, typename ReduceFunc>
+		T parallel_reduce(size_t count, size_t chunk_size, T identity, MapFunc&& map_func, ReduceFunc&& reduce_func) {
+			if (count == 0) {
+				return identity;
+			}
+			if (chunk_size == 0) {
+				chunk_size = 1;
+			}
+			const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+			std::vector<T> chunk_results(chunk_count, identity);
+			parallel_for(chunk_count, 1, [&](size_t chunk_begin, size_t chunk_end) -> void {
+				for (size_t chunk = chunk_begin; chunk < chunk_end; ++chunk) {
+					const size_t begin = chunk * chunk_size;
+					chunk_results[chunk] = map_func(begin, std::min(begin + chunk_size, count));
+				}
+			});
+			T result = identity;
+			for (T const& chunk_result : chunk_results) {
+				result = reduce_func(result, chunk_result);
+			}
+			return result;
+		}
+	};
+}